@@ -0,0 +1,107 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+/*  Measures the cost of data_block_alloc() as the disk fills up.
+    Blocks are allocated until the disk is full and the average
+    allocation time is reported for every tenth of the disk.
+    Then measures alloc/free throughput with a growing number of
+    threads (build with make ALLOC=mutex to compare against the
+    mutex-based allocator). */
+
+#define BUCKETS (10)
+#define MAX_THREADS (32)
+#define CYCLES (2000)
+#define BATCH (8)
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 +
+           (double)(end->tv_nsec - start->tv_nsec);
+}
+
+static void *alloc_free_loop(void *arg) {
+    (void)arg;
+    int blocks[BATCH];
+
+    for (int c = 0; c < CYCLES / BATCH; c++) {
+        for (int i = 0; i < BATCH; i++) {
+            blocks[i] = data_block_alloc();
+            assert(blocks[i] != -1);
+        }
+        for (int i = 0; i < BATCH; i++) {
+            assert(data_block_free(blocks[i]) == 0);
+        }
+    }
+    return NULL;
+}
+
+static void contention_bench() {
+    struct timespec start, end;
+    pthread_t threads[MAX_THREADS];
+
+#ifdef TFS_ALLOC_MUTEX
+    printf("\nallocator: mutex\n");
+#else
+    printf("\nallocator: lock-free\n");
+#endif
+    printf("%-8s %16s\n", "threads", "alloc+free/s");
+    for (int n = 1; n <= MAX_THREADS; n *= 2) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < n; i++) {
+            assert(pthread_create(&threads[i], NULL, alloc_free_loop, NULL) ==
+                   0);
+        }
+        for (int i = 0; i < n; i++) {
+            assert(pthread_join(threads[i], NULL) == 0);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("%-8d %16.0f\n", n,
+               (double)n * CYCLES * 1e9 / elapsed_ns(&start, &end));
+    }
+}
+
+int main() {
+    struct timespec start, end;
+    double bucket_ns[BUCKETS] = {0};
+    int bucket_allocs[BUCKETS] = {0};
+    int blocks[DATA_BLOCKS];
+    int allocated = 0;
+
+    assert(tfs_init() != -1);
+    /* The root directory already holds a block */
+    int used = DATA_BLOCKS - data_block_free_count();
+
+    for (;;) {
+        int bucket = (used + allocated) * BUCKETS / DATA_BLOCKS;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int b = data_block_alloc();
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (b == -1) {
+            break;
+        }
+        blocks[allocated++] = b;
+        bucket_ns[bucket] += elapsed_ns(&start, &end);
+        bucket_allocs[bucket]++;
+    }
+    assert(data_block_free_count() == 0);
+
+    printf("allocated %d blocks\n", allocated);
+    printf("%-12s %12s\n", "disk fill", "ns/alloc");
+    for (int i = 0; i < BUCKETS; i++) {
+        if (bucket_allocs[i] > 0) {
+            printf("%3d%% - %3d%% %12.0f\n", i * 100 / BUCKETS,
+                   (i + 1) * 100 / BUCKETS, bucket_ns[i] / bucket_allocs[i]);
+        }
+    }
+
+    for (int i = 0; i < allocated; i++) {
+        assert(data_block_free(blocks[i]) == 0);
+    }
+
+    contention_bench();
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
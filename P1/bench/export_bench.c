@@ -0,0 +1,129 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*  Measures tfs_copy_to_external_fs() throughput against file size, for
+    files stored in a single run of blocks and for files whose blocks are
+    interleaved with another file's. For reference, the same files are
+    also exported the way the copy used to work: the whole file is read
+    into one buffer, which is then written out. Then measures
+    tfs_copy_to_external_fs_parallel() throughput on the largest files
+    with a growing number of threads. Files of more than half the disk
+    are left out: build with FS=large for the larger sizes. */
+
+#define REPEAT (50)
+#define MB (1024.0 * 1024.0)
+
+static char const *dest = "/tmp/tfs_export_bench";
+
+static size_t const sizes[] = {4 * 1024, 64 * 1024, 512 * 1024,
+                               2 * 1024 * 1024, 6 * 1024 * 1024};
+
+#define SIZES (sizeof(sizes) / sizeof(sizes[0]))
+#define MAX_SIZE ((size_t)DATA_BLOCKS / 2 * BLOCK_SIZE)
+#define MAX_WORKERS (8)
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 +
+           (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/* Exports a file by reading it whole, then writing it */
+static void copy_whole(char const *path, size_t size) {
+    char *buffer = malloc(size);
+    assert(buffer != NULL);
+    int f = tfs_open(path, 0);
+    assert(tfs_read(f, buffer, size) == (ssize_t)size);
+    assert(tfs_close(f) != -1);
+    int fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    assert(fd != -1 && write(fd, buffer, size) == (ssize_t)size);
+    close(fd);
+    free(buffer);
+}
+
+/* Writes a file of a given size, in a single run of blocks or in runs of
+ * one block */
+static void make_file(char const *path, size_t size, bool fragmented) {
+    static char block[BLOCK_SIZE];
+    int f = tfs_open(path, TFS_O_CREAT | TFS_O_TRUNC);
+    int o = tfs_open("/other", TFS_O_CREAT | TFS_O_TRUNC);
+    assert(f != -1 && o != -1);
+    if (!fragmented) {
+        char *buffer = calloc(1, size);
+        assert(tfs_write(f, buffer, size) == (ssize_t)size);
+        free(buffer);
+    } else {
+        for (size_t at = 0; at < size; at += BLOCK_SIZE) {
+            assert(tfs_write(f, block, BLOCK_SIZE) == BLOCK_SIZE);
+            assert(tfs_write(o, block, 1) == 1);
+        }
+    }
+    assert(tfs_close(o) != -1);
+    assert(tfs_close(f) != -1);
+}
+
+int main() {
+    struct timespec start, end;
+
+    size_t count = 0;
+    while (count < SIZES && sizes[count] <= MAX_SIZE) {
+        count++;
+    }
+
+    assert(tfs_init() != -1);
+    printf("%-12s %-12s %16s %16s\n", "size", "layout", "streamed MB/s",
+           "whole MB/s");
+    for (size_t i = 0; i < count; i++) {
+        for (int fragmented = 0; fragmented <= 1; fragmented++) {
+            make_file("/f", sizes[i], fragmented);
+            /* Warms the destination file up */
+            copy_whole("/f", sizes[i]);
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int r = 0; r < REPEAT; r++) {
+                assert(tfs_copy_to_external_fs("/f", dest) == 0);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            double streamed = elapsed_ns(&start, &end);
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int r = 0; r < REPEAT; r++) {
+                copy_whole("/f", sizes[i]);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            double whole = elapsed_ns(&start, &end);
+
+            printf("%-12zu %-12s %16.0f %16.0f\n", sizes[i],
+                   fragmented ? "fragmented" : "contiguous",
+                   (double)sizes[i] * REPEAT / MB / (streamed / 1e9),
+                   (double)sizes[i] * REPEAT / MB / (whole / 1e9));
+        }
+    }
+
+    printf("\n%-12s %-12s %16s\n", "threads", "layout", "parallel MB/s");
+    size_t size = sizes[count - 1];
+    for (int fragmented = 0; fragmented <= 1; fragmented++) {
+        make_file("/f", size, fragmented);
+        copy_whole("/f", size);
+        for (int workers = 1; workers <= MAX_WORKERS; workers *= 2) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int r = 0; r < REPEAT; r++) {
+                assert(tfs_copy_to_external_fs_parallel("/f", dest, workers) ==
+                       0);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            printf("%-12d %-12s %16.0f\n", workers,
+                   fragmented ? "fragmented" : "contiguous",
+                   (double)size * REPEAT / MB /
+                       (elapsed_ns(&start, &end) / 1e9));
+        }
+    }
+    unlink(dest);
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+
+/*  Measures directory operations as the root directory grows to tens of
+    thousands of entries: the time to add an entry (add_dir_entry(), so
+    that entries need no i-nodes of their own) and the time of
+    find_in_dir() for names in the directory and for missing names.
+    find_in_dir() is used directly, so that the dentry cache does not hide
+    the directory index. The number of buckets (blocks) holding the entries
+    is shown too: build with DIRS=fixed to compare the compact entry format
+    with the fixed one. If the disk fills up, the measures stop there:
+    build with FS=large for a larger disk. */
+
+#define LOOKUPS (2000)
+
+/* Directory sizes measured */
+static size_t const checkpoints[] = {16, 64, 256, 1024, 4096, 16384, 20000};
+#define CHECKPOINTS (sizeof(checkpoints) / sizeof(checkpoints[0]))
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 +
+           (double)(end->tv_nsec - start->tv_nsec);
+}
+
+static double lookup_ns(char const *prefix, size_t names, int expected) {
+    struct timespec start, end;
+    char name[MAX_FILE_NAME];
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < LOOKUPS; i++) {
+        /* Spreads the names over the whole directory */
+        sprintf(name, "%s%zu", prefix, i * 7919 % names);
+        int inumber = find_in_dir(ROOT_DIR_INUM, name);
+        assert(expected == -1 ? inumber == -1 : inumber != -1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return elapsed_ns(&start, &end) / LOOKUPS;
+}
+
+int main() {
+    struct timespec start, end;
+    char path[MAX_FILE_NAME];
+    size_t entries = 0;
+
+    assert(tfs_init() != -1);
+    inode_t *root = inode_get(ROOT_DIR_INUM);
+    assert(root != NULL);
+
+#ifdef TFS_DIR_FIXED
+    printf("fixed directory entries\n");
+#else
+    printf("compact directory entries\n");
+#endif
+    printf("%-8s %8s %12s %12s %12s\n", "entries", "buckets", "create ns",
+           "hit ns", "miss ns");
+    for (size_t c = 0; c < CHECKPOINTS; c++) {
+        size_t n = checkpoints[c];
+        size_t added = n - entries;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (; entries < n; entries++) {
+            sprintf(path, "file%zu", entries);
+            if (add_dir_entry(ROOT_DIR_INUM, 1, path) == -1) {
+                break;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (entries < n) {
+            printf("disk full at %zu entries\n", entries);
+            break;
+        }
+        printf("%-8zu %8d %12.0f %12.0f %12.0f\n", n, root->i_dir_buckets,
+               elapsed_ns(&start, &end) / (double)added,
+               lookup_ns("file", n, 0), lookup_ns("missing", n, -1));
+    }
+
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}
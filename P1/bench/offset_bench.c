@@ -0,0 +1,86 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+
+/*  Measures read time at offsets mapped by every level of block pointers.
+    Two files are written one block at a time, alternating between them,
+    so that no two blocks of a file are contiguous and both files use
+    block pointers. Then each region of the first file is read block by
+    block from a freshly opened handle: the first block pays for the walk
+    down the indirect blocks, the rest should cost the same at any depth. */
+
+#define P ((int)MAX_BLOCK_POINTERS)
+#define D DIRECT_BLOCK_POINTERS
+#define RUN (D)
+#define REPEAT (200)
+
+static int const regions[] = {
+    0,                      /* direct */
+    D,                      /* single indirect */
+    D + P,                  /* double indirect */
+    D + P + P * P,          /* triple indirect */
+    MAX_FILE_BLOCKS - RUN,  /* end of the largest file */
+};
+static char const *names[] = {"direct", "single", "double", "triple",
+                              "triple (end)"};
+
+#define REGIONS (sizeof(regions) / sizeof(regions[0]))
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 +
+           (double)(end->tv_nsec - start->tv_nsec);
+}
+
+static void write_block(int f, int lblock, char *block) {
+    off_t offset = (off_t)lblock * BLOCK_SIZE;
+    assert(tfs_lseek(f, offset, TFS_SEEK_SET) == offset);
+    assert(tfs_write(f, block, BLOCK_SIZE) == BLOCK_SIZE);
+}
+
+int main() {
+    struct timespec start, mid, end;
+    char block[BLOCK_SIZE] = {'x'};
+
+    assert(tfs_init() != -1);
+
+    int a = tfs_open("/a", TFS_O_CREAT);
+    int b = tfs_open("/b", TFS_O_CREAT);
+    assert(a != -1 && b != -1);
+    for (size_t r = 0; r < REGIONS; r++) {
+        for (int i = 0; i < RUN; i++) {
+            write_block(a, regions[r] + i, block);
+            write_block(b, regions[r] + i, block);
+        }
+    }
+    assert(tfs_close(a) != -1 && tfs_close(b) != -1);
+
+    printf("%-14s %12s %16s %16s\n", "region", "first block",
+           "first block ns", "next blocks ns");
+    for (size_t r = 0; r < REGIONS; r++) {
+        double first_ns = 0, next_ns = 0;
+        off_t offset = (off_t)regions[r] * BLOCK_SIZE;
+
+        for (int k = 0; k < REPEAT; k++) {
+            int f = tfs_open("/a", 0);
+            assert(f != -1);
+            assert(tfs_lseek(f, offset, TFS_SEEK_SET) == offset);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            assert(tfs_read(f, block, BLOCK_SIZE) == BLOCK_SIZE);
+            clock_gettime(CLOCK_MONOTONIC, &mid);
+            for (int i = 1; i < RUN; i++) {
+                assert(tfs_read(f, block, BLOCK_SIZE) == BLOCK_SIZE);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            assert(tfs_close(f) != -1);
+            first_ns += elapsed_ns(&start, &mid);
+            next_ns += elapsed_ns(&mid, &end);
+        }
+        printf("%-14s %12d %16.0f %16.0f\n", names[r], regions[r],
+               first_ns / REPEAT, next_ns / (REPEAT * (RUN - 1)));
+    }
+
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}
@@ -5,8 +5,13 @@
 #define ROOT_DIR_INUM (0)
 
 #define BLOCK_SIZE (1024)
+/* Both can be set when building (see FS=large in the Makefile) */
+#ifndef DATA_BLOCKS
 #define DATA_BLOCKS (1024)
+#endif
+#ifndef INODE_TABLE_SIZE
 #define INODE_TABLE_SIZE (50)
+#endif
 #define MAX_OPEN_FILES (20)
 #define MAX_FILE_NAME (40)
 
@@ -16,7 +21,49 @@
 #define DIRECT_BLOCK_POINTERS (10)
 #define MAX_BLOCK_POINTERS (BLOCK_SIZE/INDEX_SIZE)
 #define EMPTY (-1)
-#define MAX_FILE_SIZE ((MAX_BLOCK_POINTERS + DIRECT_BLOCK_POINTERS)*BLOCK_SIZE)
+/* Single, double and triple indirect blocks */
+#define INDIRECT_LEVELS (3)
+#define MAX_FILE_SIZE                                                          \
+    ((DIRECT_BLOCK_POINTERS + MAX_BLOCK_POINTERS +                             \
+      MAX_BLOCK_POINTERS * MAX_BLOCK_POINTERS +                                \
+      MAX_BLOCK_POINTERS * MAX_BLOCK_POINTERS * MAX_BLOCK_POINTERS) *          \
+     BLOCK_SIZE)
+#define MAX_FILE_BLOCKS ((int)(MAX_FILE_SIZE / BLOCK_SIZE))
+#define INODE_EXTENTS (4)
+/* Runs of the block map cached in each open file entry */
+#define OF_MAP_WINDOW (8)
+#define BITMAP_WORD_BITS (64)
+#define BITMAP_WORDS ((DATA_BLOCKS + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS)
+/* Per-thread block magazine capacity, and how many blocks are moved at once
+ * between a magazine and the free block bitmap */
+#define MAGAZINE_SIZE (16)
+#define MAGAZINE_BATCH (MAGAZINE_SIZE / 2)
+#define INODE_BITMAP_WORDS                                                     \
+    ((INODE_TABLE_SIZE + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS)
+/* File blocks of a directory reserved for its hash index, which bounds it
+ * to DIR_INDEX_BLOCKS * MAX_BLOCK_POINTERS buckets */
+#define DIR_INDEX_BLOCKS (64)
+/* Directory Bloom filters: bits kept per name (the filter doubles to keep
+ * it), bit probes per name, and initial size in bits (a power of two) */
+#define DIR_BLOOM_BITS_PER_NAME (10)
+#define DIR_BLOOM_HASHES (4)
+#define DIR_BLOOM_MIN_BITS (1024)
+/* Slots of the in-memory (parent, name) -> i-node cache */
+#define DENTRY_CACHE_SIZE (64)
+/* Byte ranges that can be locked at once in each i-node */
+#define RANGE_LOCK_SLOTS (16)
+/* Lock-free read attempts before a read takes the i-node's locks */
+#define SEQ_READ_RETRIES (4)
+/* Contiguous runs of a file that a read or write maps at once */
+#define MAP_SEGMENTS (16)
+/* Contiguous runs of a file that a read view can hold */
+#define VIEW_SPANS (MAP_SEGMENTS)
+/* Bytes of zeros written at once for the holes of an exported file */
+#define COPY_BUFFER_SIZE (16 * BLOCK_SIZE)
+/* Operations that can be in flight in the asynchronous interface, and
+ * threads that can run them */
+#define ASYNC_RING_SIZE (512)
+#define ASYNC_MAX_WORKERS (64)
 /* Fim das Criadas */
 
 #define DELAY (5000)
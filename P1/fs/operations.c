@@ -1,8 +1,15 @@
 #include "operations.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <pthread.h>
 
 int tfs_init() {
@@ -26,69 +33,122 @@ static bool valid_pathname(char const *name) {
     return name != NULL && strlen(name) > 1 && name[0] == '/';
 }
 
-int tfs_lookup(char const *name) {
+/*
+ * Walks a path name down to the directory holding its last component.
+ * Input:
+ *  - name: absolute path name
+ *  - leaf: set to the last component of the path (MAX_FILE_NAME bytes)
+ * Returns: i-number of the parent directory, -1 if some directory on the
+ * way does not exist or the path is not valid (empty components, or
+ * components of MAX_FILE_NAME characters or more)
+ */
+static int path_walk(char const *name, char *leaf) {
+    int inumber = ROOT_DIR_INUM;
+
     if (!valid_pathname(name)) {
         return -1;
     }
-
     // skip the initial '/' character
     name++;
 
-    return find_in_dir(ROOT_DIR_INUM, name);
+    for (;;) {
+        char const *end = strchr(name, '/');
+        size_t len = end == NULL ? strlen(name) : (size_t)(end - name);
+        if (len == 0 || len >= MAX_FILE_NAME) {
+            return -1;
+        }
+        memcpy(leaf, name, len);
+        leaf[len] = '\0';
+        if (end == NULL) {
+            return inumber;
+        }
+        /* Intermediate components go through the dentry cache; if one of
+         * them is a file, looking inside it fails */
+        inumber = dentry_lookup(inumber, leaf);
+        if (inumber == -1) {
+            return -1;
+        }
+        name = end + 1;
+    }
+}
+
+int tfs_lookup(char const *name) {
+    char leaf[MAX_FILE_NAME];
+
+    int parent = path_walk(name, leaf);
+    if (parent == -1) {
+        return -1;
+    }
+
+    return dentry_lookup(parent, leaf);
 }
 
 int tfs_open(char const *name, int flags) {
     int inum;
     size_t offset;
+    char leaf[MAX_FILE_NAME];
 
-    /* Checks if the path name is valid */
-    if (!valid_pathname(name)) {
+    /* Checks if the path name is valid, and finds the directory holding
+     * the file */
+    int parent = path_walk(name, leaf);
+    if (parent == -1) {
         return -1;
     }
 
-    inum = tfs_lookup(name);
-    if (inum >= 0) {
-        /* The file already exists */
-        inode_t *inode = inode_get(inum);
-        if (inode == NULL) {
+    inum = dentry_lookup(parent, leaf);
+    if (inum < 0) {
+        if (!(flags & TFS_O_CREAT)) {
             return -1;
         }
-        /* Truncate (if requested) */
-        if (flags & TFS_O_TRUNC) {
-            if (inode_data_free(inum) == -1) return -1;
-            inode_metadata_reset(inum);
-        }
-
-        /* Determine initial offset */
-        if (flags & TFS_O_APPEND) {
-            /* Bloqueia o trinco read write do inode em read. */
-            pthread_rwlock_rdlock(&inode->i_lock);
-            offset = inode->i_size;
-            /* Desloqueia o trinco read write do inode. */
-            pthread_rwlock_unlock(&inode->i_lock);
-        } else {
-            offset = 0;
-        }
-    } else if (flags & TFS_O_CREAT) {
         /* The file doesn't exist; the flags specify that it should be created*/
         /* Create inode */
         inum = inode_create(T_FILE);
         if (inum == -1) {
             return -1;
         }
-        /* Add entry in the root directory */
-        if (add_dir_entry(ROOT_DIR_INUM, inum, name + 1) == -1) {
-            inode_delete(inum);
+        /* Add entry in the parent directory */
+        if (add_dir_entry(parent, inum, leaf) != -1) {
+            return add_to_open_file_table(inum, 0,
+                                          (flags & TFS_O_APPEND) != 0);
+        }
+        inode_delete(inum);
+        /* Another thread may have created the file in the meantime */
+        inum = dentry_lookup(parent, leaf);
+        if (inum < 0) {
             return -1;
         }
-        offset = 0;
-    } else {
+    }
+
+    /* The file already exists */
+    inode_t *inode = inode_get(inum);
+    if (inode == NULL || inode->i_node_type != T_FILE) {
         return -1;
     }
+    /* Truncate (if requested) */
+    if (flags & TFS_O_TRUNC) {
+        /* Waits for the reads and writes in progress */
+        int range = inode_range_lock(inode, 0, MAX_FILE_SIZE, true);
+        inode_write_begin(inode);
+        int r = inode_data_free(inum);
+        if (r != -1) {
+            inode_metadata_reset(inum);
+        }
+        inode_write_end(inode);
+        inode_range_unlock(inode, range);
+        if (r == -1) return -1;
+    }
+
+    /* Determine initial offset (writes to append handles move it to
+     * the end of the file) */
+    if (flags & TFS_O_APPEND) {
+        offset = inode->i_size;
+    } else {
+        offset = 0;
+    }
 
     /* Finally, add entry to the open file table and
      * return the corresponding handle */
-    return add_to_open_file_table(inum, offset);
+    return add_to_open_file_table(inum, offset, (flags & TFS_O_APPEND) != 0);
 
     /* Note: for simplification, if file was created with TFS_O_CREAT and there
      * is an error adding an entry to the open file table, the file is not
@@ -96,173 +156,1014 @@ int tfs_open(char const *name, int flags) {
 }
 
 
+int tfs_mkdir(char const *name) {
+    char leaf[MAX_FILE_NAME];
+
+    int parent = path_walk(name, leaf);
+    if (parent == -1) {
+        return -1;
+    }
+
+    int inum = inode_create(T_DIRECTORY);
+    if (inum == -1) {
+        return -1;
+    }
+    /* Fails if the name is already taken */
+    if (add_dir_entry(parent, inum, leaf) == -1) {
+        inode_delete(inum);
+        return -1;
+    }
+    return 0;
+}
+
 int tfs_close(int fhandle) { return remove_from_open_file_table(fhandle); }
 
+/* Returns the offset of an open file entry */
+static size_t file_position(open_file_entry_t *file) {
+    /* Bloqueia o trinco  da open file entry. */
+    pthread_mutex_lock(&file->of_mutex);
+    size_t position_in_file =
+        (size_t)file->of_boffset * BLOCK_SIZE + file->of_offset;
+    /* Desloqueia o trinco da open file entry . */
+    pthread_mutex_unlock(&file->of_mutex);
+    return position_in_file;
+}
+
+/* Moves the offset of an open file entry */
+static void file_seek(open_file_entry_t *file, size_t position_in_file) {
+    /* Bloqueia o trinco  da open file entry. */
+    pthread_mutex_lock(&file->of_mutex);
+    file->of_boffset = (int)(position_in_file / BLOCK_SIZE);
+    file->of_offset = position_in_file % BLOCK_SIZE;
+    /* Desloqueia o trinco da open file entry . */
+    pthread_mutex_unlock(&file->of_mutex);
+}
+
+/*
+ * Returns the total length of a vector of buffers, or -1 if the vector is
+ * not valid (a negative number of buffers, or more bytes than a result can
+ * report)
+ */
+static ssize_t iov_length(struct iovec const *iov, int iovcnt) {
+    if (iovcnt < 0 || (iovcnt > 0 && iov == NULL)) {
+        return -1;
+    }
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > (size_t)SSIZE_MAX - len) {
+            return -1;
+        }
+        len += iov[i].iov_len;
+    }
+    return (ssize_t)len;
+}
+
+/*
+ * Writes to a file at a position, with the bytes written already locked
+ * (and inode_write_begin() called) by the caller.
+ * Returns the number of bytes written, or -1 if the disk is full
+ */
+static ssize_t write_locked(open_file_entry_t *file, inode_t *inode,
+                            iov_cursor_t *cursor, size_t to_write,
+                            size_t position_in_file) {
+    segment_t segments[MAP_SEGMENTS];
+    size_t written = 0;
+
+    while (written < to_write) {
+        /* Maps, allocating what is missing, up to MAP_SEGMENTS contiguous
+         * runs under a single lock of the i-node */
+        int count = inode_map(file, inode, position_in_file + written,
+                              to_write - written, true, segments,
+                              MAP_SEGMENTS);
+        if (count == 0) {
+            /* Out of space: reports what was written so far */
+            break;
+        }
+        /* Perform the actual write, with a single copy per run and buffer,
+         * and advance in the buffers */
+        for (int i = 0; i < count; i++) {
+            iov_copy_from(cursor, segments[i].s_data, segments[i].s_len);
+            written += segments[i].s_len;
+        }
+    }
+    if (written == 0 && to_write > 0) {
+        return -1;
+    }
+
+    /* The file grows, once, if the write went past its end (writing after a
+     * seek past the end leaves a hole in between) */
+    inode_size_extend(inode, position_in_file + written);
+    return (ssize_t)written;
+}
+
+/* Writes to a file at a position (see tfs_pwrite()) */
+static ssize_t write_at(open_file_entry_t *file, inode_t *inode,
+                        struct iovec const *iov, int iovcnt, size_t to_write,
+                        size_t position_in_file) {
+    /* Determine how many bytes to write */
+    if (position_in_file >= MAX_FILE_SIZE) {
+        return 0;
+    }
+    if (to_write > MAX_FILE_SIZE - position_in_file) {
+        to_write = MAX_FILE_SIZE - position_in_file;
+    }
+
+    iov_cursor_t cursor;
+    iov_cursor_init(&cursor, iov, iovcnt);
+    /* Writers of other parts of the file go on in parallel */
+    int range = inode_range_lock(inode, position_in_file,
+                                 position_in_file + to_write, true);
+    /* Lock-free readers retry if they overlap the write */
+    inode_write_begin(inode);
+    ssize_t written =
+        write_locked(file, inode, &cursor, to_write, position_in_file);
+    inode_write_end(inode);
+    inode_range_unlock(inode, range);
+    return written;
+}
+
 ssize_t tfs_write(int fhandle, void const *buffer, size_t to_write) {
+    struct iovec iov = {(void *)buffer, to_write};
+    return tfs_writev(fhandle, &iov, 1);
+}
+
+ssize_t tfs_writev(int fhandle, struct iovec const *iov, int iovcnt) {
+    ssize_t len = iov_length(iov, iovcnt);
     open_file_entry_t *file = get_open_file_entry(fhandle);
-    if (file == NULL) {
+    if (file == NULL || len == -1) {
         return -1;
     }
 
-    size_t to_write_aux = 0;
-    size_t to_write_receiver = to_write;
+    /* From the open file table entry, we get the inode */
+    inode_t *inode = inode_get(file->of_inumber);
+    if (inode == NULL) {
+        return -1;
+    }
+
+    /* All the buffers are written under a single lock of the i-node */
+    size_t to_write = (size_t)len;
+    size_t position_in_file;
+    ssize_t written;
+    if (file->of_append) {
+        /* Appends reserve their bytes at the end of the file at once, so
+         * that appends through other handles go after them, and fill them
+         * in parallel (lock-free readers retry if they overlap the write) */
+        int range =
+            inode_range_lock_append(inode, &position_in_file, &to_write);
+        if (range == -1) {
+            return 0;
+        }
+        iov_cursor_t cursor;
+        iov_cursor_init(&cursor, iov, iovcnt);
+        written =
+            write_locked(file, inode, &cursor, to_write, position_in_file);
+        if (written < (ssize_t)to_write) {
+            /* The disk filled up: what was not written is not kept */
+            inode_size_shrink(inode, position_in_file + to_write,
+                              position_in_file +
+                                  (written > 0 ? (size_t)written : 0));
+        }
+        inode_write_end(inode);
+        inode_range_unlock(inode, range);
+    } else {
+        position_in_file = file_position(file);
+        written =
+            write_at(file, inode, iov, iovcnt, to_write, position_in_file);
+    }
+
+    /* The offset associated with the file handle is
+     * incremented accordingly */
+    if (written > 0) {
+        file_seek(file, position_in_file + (size_t)written);
+    }
+    return written;
+}
+
+ssize_t tfs_pwrite(int fhandle, void const *buffer, size_t len, off_t offset) {
+    open_file_entry_t *file = get_open_file_entry(fhandle);
+    if (file == NULL || offset < 0) {
+        return -1;
+    }
+    inode_t *inode = inode_get(file->of_inumber);
+    if (inode == NULL) {
+        return -1;
+    }
+
+    struct iovec iov = {(void *)buffer, len};
+    return write_at(file, inode, &iov, 1, len, (size_t)offset);
+}
+
+/*
+ * Reads from a file at a position, with the bytes read already locked by
+ * the caller, and no further than its end.
+ * Returns the number of bytes read, or -1 in case of error
+ */
+static ssize_t read_locked(open_file_entry_t *file, inode_t *inode,
+                           iov_cursor_t *cursor, size_t to_read,
+                           size_t position_in_file) {
+    segment_t segments[MAP_SEGMENTS];
+    size_t done = 0;
+
+    while (done < to_read) {
+        /* Maps up to MAP_SEGMENTS contiguous runs (or holes) under a single
+         * lock of the i-node */
+        int count = inode_map(file, inode, position_in_file + done,
+                              to_read - done, false, segments, MAP_SEGMENTS);
+        if (count == 0) {
+            return -1;
+        }
+        /* Perform the actual read, with a single copy per run and buffer
+         * (holes read as zeros, without touching any data block), and
+         * advance in the buffers */
+        for (int i = 0; i < count; i++) {
+            iov_copy_to(cursor, segments[i].s_data, segments[i].s_len);
+            done += segments[i].s_len;
+        }
+    }
+    return (ssize_t)to_read;
+}
+
+/* Reads from a file at a position (see tfs_pread()) */
+static ssize_t read_at(open_file_entry_t *file, inode_t *inode,
+                       struct iovec const *iov, int iovcnt, size_t len,
+                       size_t position_in_file) {
+    /* Reads that no writer gets in the way of take no lock of the i-node */
+    ssize_t read =
+        inode_read_seq(file, inode, iov, iovcnt, len, position_in_file);
+    if (read != -1) {
+        return read;
+    }
+
+    if (position_in_file >= MAX_FILE_SIZE) {
+        return 0;
+    }
+    if (len > MAX_FILE_SIZE - position_in_file) {
+        len = MAX_FILE_SIZE - position_in_file;
+    }
+
+    iov_cursor_t cursor;
+    iov_cursor_init(&cursor, iov, iovcnt);
+    /* Only writers of the same bytes are waited for */
+    int range = inode_range_lock(inode, position_in_file,
+                                 position_in_file + len, false);
+    /* Determine how many bytes to read, once writers of these bytes and
+     * truncations are done with the size */
+    size_t size = inode->i_size;
+    size_t to_read = 0;
+    if (size > position_in_file) {
+        to_read = size - position_in_file;
+    }
+    if (to_read > len) {
+        to_read = len;
+    }
+    read = read_locked(file, inode, &cursor, to_read, position_in_file);
+    inode_range_unlock(inode, range);
+    return read;
+}
+
+ssize_t tfs_read(int fhandle, void *buffer, size_t len) {
+    struct iovec iov = {buffer, len};
+    return tfs_readv(fhandle, &iov, 1);
+}
 
+ssize_t tfs_readv(int fhandle, struct iovec const *iov, int iovcnt) {
+    ssize_t len = iov_length(iov, iovcnt);
+    open_file_entry_t *file = get_open_file_entry(fhandle);
+    if (file == NULL || len == -1) {
+        return -1;
+    }
     /* From the open file table entry, we get the inode */
     inode_t *inode = inode_get(file->of_inumber);
     if (inode == NULL) {
         return -1;
     }
 
-    /* Determine how many bytes to write */
-    while (to_write > 0) {
-        if (to_write + file->of_offset > BLOCK_SIZE) {
-            to_write_aux = BLOCK_SIZE - file->of_offset;
-        } else {
-            to_write_aux = to_write;
-        }
-         
-        if (to_write_aux > 0) {
-            char *position = inode_update(file);
-            if (position == NULL) {
+    /* All the buffers are filled under a single lock of the i-node */
+    size_t position_in_file = file_position(file);
+    ssize_t read =
+        read_at(file, inode, iov, iovcnt, (size_t)len, position_in_file);
+    /* The offset associated with the file handle is
+     * incremented accordingly */
+    if (read > 0) {
+        file_seek(file, position_in_file + (size_t)read);
+    }
+    return read;
+}
+
+ssize_t tfs_pread(int fhandle, void *buffer, size_t len, off_t offset) {
+    open_file_entry_t *file = get_open_file_entry(fhandle);
+    if (file == NULL || offset < 0) {
+        return -1;
+    }
+    inode_t *inode = inode_get(file->of_inumber);
+    if (inode == NULL) {
+        return -1;
+    }
+
+    struct iovec iov = {buffer, len};
+    return read_at(file, inode, &iov, 1, len, (size_t)offset);
+}
+
+ssize_t tfs_view(int fhandle, off_t offset, size_t len, tfs_view_t *view) {
+    view->v_inode = NULL;
+    view->v_count = 0;
+
+    open_file_entry_t *file = get_open_file_entry(fhandle);
+    if (file == NULL || offset < 0) {
+        return -1;
+    }
+    inode_t *inode = inode_get(file->of_inumber);
+    if (inode == NULL) {
+        return -1;
+    }
+
+    /* Determine how many bytes to map */
+    size_t position_in_file = (size_t)offset;
+    size_t size = inode->i_size;
+    size_t to_map = size > position_in_file ? size - position_in_file : 0;
+    if (to_map > len) {
+        to_map = len;
+    }
+    if (to_map == 0) {
+        return 0;
+    }
+
+    /* The bytes are pinned by a read lock of their range, held until the
+     * view is released: truncations lock the whole file */
+    int range = inode_range_lock(inode, position_in_file,
+                                 position_in_file + to_map, false);
+    /* A truncation may have come first */
+    size = inode->i_size;
+    if (size < position_in_file + to_map) {
+        to_map = size > position_in_file ? size - position_in_file : 0;
+    }
+
+    segment_t segments[VIEW_SPANS];
+    int count = to_map == 0 ? 0
+                            : inode_map(file, inode, position_in_file, to_map,
+                                        false, segments, VIEW_SPANS);
+    if (count == 0) {
+        inode_range_unlock(inode, range);
+        return to_map == 0 ? 0 : -1;
+    }
+
+    size_t mapped = 0;
+    for (int i = 0; i < count; i++) {
+        view->v_spans[i].vs_base = segments[i].s_data;
+        view->v_spans[i].vs_len = segments[i].s_len;
+        mapped += segments[i].s_len;
+    }
+    view->v_inode = inode;
+    view->v_range = range;
+    view->v_count = count;
+    return (ssize_t)mapped;
+}
+
+void tfs_view_release(tfs_view_t *view) {
+    if (view->v_inode != NULL) {
+        inode_range_unlock(view->v_inode, view->v_range);
+        view->v_inode = NULL;
+    }
+    view->v_count = 0;
+}
+
+void *tfs_map(int fhandle, off_t offset, size_t len, tfs_map_t *map) {
+    open_file_entry_t *file = get_open_file_entry(fhandle);
+    if (file == NULL || offset < 0 || len == 0 ||
+        (size_t)offset >= MAX_FILE_SIZE) {
+        return NULL;
+    }
+    inode_t *inode = inode_get(file->of_inumber);
+    if (inode == NULL) {
+        return NULL;
+    }
+    size_t position_in_file = (size_t)offset;
+    if (len > MAX_FILE_SIZE - position_in_file) {
+        len = MAX_FILE_SIZE - position_in_file;
+    }
+
+    /* The mapped bytes are locked as by a write until the mapping is
+     * released, and lock-free readers of them retry meanwhile */
+    int range = inode_range_lock(inode, position_in_file,
+                                 position_in_file + len, true);
+    inode_write_begin(inode);
+
+    /* When every byte is already stored in a single run, it is used in
+     * place */
+    segment_t segment;
+    char *data = NULL;
+    char *buffer = NULL;
+    if (inode_map(file, inode, position_in_file, len, false, &segment, 1) ==
+            1 &&
+        segment.s_data != NULL && segment.s_len == len) {
+        data = segment.s_data;
+    } else {
+        /* Otherwise the bytes are gathered in a buffer, and written back
+         * when the mapping is released (bytes past the end of the file, or
+         * in holes, start as zeros) */
+        buffer = calloc(1, len);
+        size_t size = inode->i_size;
+        size_t to_read = size > position_in_file ? size - position_in_file : 0;
+        if (to_read > len) {
+            to_read = len;
+        }
+        struct iovec iov = {buffer, to_read};
+        iov_cursor_t cursor;
+        iov_cursor_init(&cursor, &iov, 1);
+        if (buffer == NULL ||
+            read_locked(file, inode, &cursor, to_read, position_in_file) ==
+                -1) {
+            free(buffer);
+            inode_write_end(inode);
+            inode_range_unlock(inode, range);
+            return NULL;
+        }
+        data = buffer;
+    }
+
+    map->m_file = file;
+    map->m_inode = inode;
+    map->m_range = range;
+    map->m_position = position_in_file;
+    map->m_len = len;
+    map->m_data = data;
+    map->m_buffer = buffer;
+    return data;
+}
+
+/*
+ * Writes back bytes of a mapping's buffer, from start to end (offsets in
+ * the mapping)
+ * Returns 0 if successful, -1 if the disk is full
+ */
+static int map_write_run(tfs_map_t *map, size_t start, size_t end) {
+    if (start == end) {
+        return 0;
+    }
+    struct iovec iov = {map->m_buffer + start, end - start};
+    iov_cursor_t cursor;
+    iov_cursor_init(&cursor, &iov, 1);
+    ssize_t written = write_locked(map->m_file, map->m_inode, &cursor,
+                                   end - start, map->m_position + start);
+    return written == (ssize_t)(end - start) ? 0 : -1;
+}
+
+/*
+ * Writes back the first bytes of a mapping's buffer. Blocks (or parts of
+ * them) that are holes in the file and still zeros in the buffer are
+ * skipped, so that they stay holes.
+ * Returns 0 if successful, -1 if the disk is full
+ */
+static int map_write_back(tfs_map_t *map, size_t written) {
+    static char const zeros[BLOCK_SIZE];
+    size_t start = 0;
+    size_t at = 0;
+
+    while (at < written) {
+        size_t position_in_file = map->m_position + at;
+        size_t n = BLOCK_SIZE - position_in_file % BLOCK_SIZE;
+        if (n > written - at) {
+            n = written - at;
+        }
+        segment_t segment;
+        if (memcmp(map->m_buffer + at, zeros, n) == 0 &&
+            (inode_map(map->m_file, map->m_inode, position_in_file, n, false,
+                       &segment, 1) == 0 ||
+             segment.s_data == NULL)) {
+            if (map_write_run(map, start, at) == -1) {
                 return -1;
             }
-            /* Bloqueia o trinco read write do inode em write. */
-            pthread_rwlock_wrlock(&inode->i_lock);
-            /* Perform the actual write */
-            memcpy(position, buffer, to_write_aux);
-            /* Desloqueia o trinco read write do inode. */
-            pthread_rwlock_unlock(&inode->i_lock);
-            /* Avança o buffer */
-            buffer += to_write_aux;
-        }
-    
-        /* The offset associated with the file handle is
-        * incremented accordingly */
-       /* Bloqueia o trinco  da open file entry. */
-        pthread_mutex_lock(&file->of_mutex);
-        file->of_offset += to_write_aux;
-        if (file->of_offset >= BLOCK_SIZE ) {
-            file->of_offset -= BLOCK_SIZE;
-            file->of_boffset++;
+            start = at + n;
         }
-        /* Desloqueia o trinco da open file entry . */
-        pthread_mutex_unlock(&file->of_mutex);
-        /* Bloqueia o trinco read write do inode em write. */
-        pthread_rwlock_wrlock(&inode->i_lock);
-        inode->i_size += to_write_aux;
-        /* Desloqueia o trinco read write do inode. */
-        pthread_rwlock_unlock(&inode->i_lock);
-        to_write -= to_write_aux;
+        at += n;
     }
-    return (ssize_t)to_write_receiver;
+    return map_write_run(map, start, written);
 }
 
-ssize_t tfs_read(int fhandle, void *buffer, size_t len) {
+int tfs_unmap(tfs_map_t *map, size_t written) {
+    int result = 0;
+    if (written > map->m_len) {
+        written = map->m_len;
+    }
+    if (map->m_buffer != NULL) {
+        /* Writes back what was written to the gathered bytes */
+        result = map_write_back(map, written);
+        free(map->m_buffer);
+    }
+    if (result == 0 && written > 0) {
+        /* The file grows to cover the bytes written (and no further) */
+        inode_size_extend(map->m_inode, map->m_position + written);
+    }
+    inode_write_end(map->m_inode);
+    inode_range_unlock(map->m_inode, map->m_range);
+    map->m_data = NULL;
+    map->m_buffer = NULL;
+    return result;
+}
+
+off_t tfs_lseek(int fhandle, off_t offset, int whence) {
     open_file_entry_t *file = get_open_file_entry(fhandle);
     if (file == NULL) {
         return -1;
     }
-    /* From the open file table entry, we get the inode */
     inode_t *inode = inode_get(file->of_inumber);
     if (inode == NULL) {
         return -1;
     }
-    
+
     /* Bloqueia o trinco  da open file entry. */
     pthread_mutex_lock(&file->of_mutex);
-    /* Bloqueia o trinco read write do inode em read. */
-    pthread_rwlock_rdlock(&inode->i_lock);
-    /* Determine how many bytes to read */
-    size_t to_read = inode->i_size - file->of_offset;
-    /* Desloqueia o trinco read write do inode. */
-    pthread_rwlock_unlock(&inode->i_lock);
-    /* Desloqueia o trinco da open file entry . */
-    pthread_mutex_unlock(&file->of_mutex);
-    if (to_read > len) {
-        to_read = len;
+    off_t base;
+    switch (whence) {
+    case TFS_SEEK_SET:
+        base = 0;
+        break;
+    case TFS_SEEK_CUR:
+        base = (off_t)file->of_boffset * BLOCK_SIZE + (off_t)file->of_offset;
+        break;
+    case TFS_SEEK_END:
+        /* Bloqueia o trinco read write do inode em read. */
+        pthread_rwlock_rdlock(&inode->i_lock);
+        base = (off_t)inode->i_size;
+        /* Desloqueia o trinco read write do inode. */
+        pthread_rwlock_unlock(&inode->i_lock);
+        break;
+    default:
+        /* Desloqueia o trinco da open file entry . */
+        pthread_mutex_unlock(&file->of_mutex);
+        return -1;
     }
 
-    size_t to_read_aux;
-    size_t to_read_receiver = to_read;
-    while (to_read > 0) {
-        /* Bloqueia o trinco  da open file entry. */
-        pthread_mutex_lock(&file->of_mutex);
-        if (file->of_offset + to_read >= BLOCK_SIZE) {
-            to_read_aux = BLOCK_SIZE - file->of_offset;
-        } else {
-            to_read_aux = to_read;
-        }
+    off_t position_in_file = base + offset;
+    if (position_in_file < 0 || position_in_file > MAX_FILE_SIZE) {
         /* Desloqueia o trinco da open file entry . */
         pthread_mutex_unlock(&file->of_mutex);
+        return -1;
+    }
+    file->of_boffset = (int)(position_in_file / BLOCK_SIZE);
+    file->of_offset = (size_t)(position_in_file % BLOCK_SIZE);
+    /* Desloqueia o trinco da open file entry . */
+    pthread_mutex_unlock(&file->of_mutex);
+    return position_in_file;
+}
 
-        if (to_read_aux > 0) {
-            char *position = inode_update(file);
-            if (position == NULL) {
-                return -1;
+/* Writes all of a buffer to a descriptor
+ * Returns 0 if successful, -1 otherwise */
+static int write_all(int fd, void const *buffer, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, buffer, len);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
             }
+            return -1;
+        }
+        buffer = (char const *)buffer + written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
 
-            /* Bloqueia o trinco read write do inode em read. */
-            pthread_rwlock_rdlock(&inode->i_lock);
-            /* Perform the actual read */
-            memcpy(buffer, position, to_read);
-            /* Desloqueia o trinco read write do inode. */
-            pthread_rwlock_unlock(&inode->i_lock);
-            /* Avança o buffer */
-            buffer += to_read_aux;
-        }
-       /* Bloqueia o trinco  da open file entry. */
-        pthread_mutex_lock(&file->of_mutex);
-        file->of_offset += to_read_aux;
-        if (file->of_offset >= BLOCK_SIZE ) {
-            file->of_offset -= BLOCK_SIZE;
-            file->of_boffset++;
+int tfs_copy_to_external_fs(char const *source_path, char const *dest_path) {
+    /* Holes are written from here, a bounded staging buffer at a time */
+    static char const zeros[COPY_BUFFER_SIZE];
+
+    int source = tfs_open(source_path, 0);
+    if (source == -1) {
+        return -1;
+    }
+    int dest = open(dest_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (dest == -1) {
+        tfs_close(source);
+        return -1;
+    }
+
+    /* The file is streamed a view (up to VIEW_SPANS contiguous runs) at a
+     * time, each run written straight from the blocks that hold it */
+    int result = 0;
+    off_t offset = 0;
+    tfs_view_t view;
+    for (;;) {
+        ssize_t len = tfs_view(source, offset, MAX_FILE_SIZE, &view);
+        if (len <= 0) {
+            result = (int)len;
+            break;
         }
-        /* Desloqueia o trinco da open file entry . */
-        pthread_mutex_unlock(&file->of_mutex);
-        to_read -= to_read_aux;
+        for (int i = 0; i < view.v_count && result == 0; i++) {
+            tfs_span_t *span = &view.v_spans[i];
+            if (span->vs_base != NULL) {
+                result = write_all(dest, span->vs_base, span->vs_len);
+                continue;
+            }
+            for (size_t done = 0; done < span->vs_len && result == 0;
+                 done += COPY_BUFFER_SIZE) {
+                size_t n = span->vs_len - done;
+                result = write_all(dest, zeros,
+                                   n < COPY_BUFFER_SIZE ? n : COPY_BUFFER_SIZE);
+            }
+        }
+        tfs_view_release(&view);
+        if (result == -1) {
+            break;
+        }
+        offset += len;
     }
 
-    return (ssize_t)to_read_receiver;
+    if (close(dest) == -1) {
+        result = -1;
+    }
+    if (tfs_close(source) == -1) {
+        result = -1;
+    }
+    return result;
 }
 
-int tfs_copy_to_external_fs(char const *source_path, char const *dest_path) {
+int tfs_copy_from_external_fs(char const *source_path, char const *dest_path) {
+    int source = open(source_path, O_RDONLY);
+    if (source == -1) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(source, &st) == -1 || !S_ISREG(st.st_mode) ||
+        (uintmax_t)st.st_size > MAX_FILE_SIZE) {
+        close(source);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+
+    /* The source is read straight from its pages, without a staging
+     * buffer (an empty file cannot be mapped) */
+    void *contents = NULL;
+    if (size > 0) {
+        contents = mmap(NULL, size, PROT_READ, MAP_PRIVATE, source, 0);
+        if (contents == MAP_FAILED) {
+            close(source);
+            return -1;
+        }
+    }
+
+    /* A single write allocates every block the file needs at once (in as
+     * few contiguous runs as the free blocks allow), then fills each run
+     * with a single copy */
+    int result = -1;
+    int dest = tfs_open(dest_path, TFS_O_CREAT | TFS_O_TRUNC);
+    if (dest != -1) {
+        if (size == 0 || tfs_write(dest, contents, size) == (ssize_t)size) {
+            result = 0;
+        }
+        if (tfs_close(dest) == -1) {
+            result = -1;
+        }
+    }
+
+    if (size > 0) {
+        munmap(contents, size);
+    }
+    close(source);
+    return result;
+}
+
+/* Writes all of a buffer to a descriptor, at an offset
+ * Returns 0 if successful, -1 otherwise */
+static int pwrite_all(int fd, void const *buffer, size_t len, size_t offset) {
+    while (len > 0) {
+        ssize_t written = pwrite(fd, buffer, len, (off_t)offset);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buffer = (char const *)buffer + written;
+        len -= (size_t)written;
+        offset += (size_t)written;
+    }
+    return 0;
+}
+
+/*
+ * Part of a file exported by a worker of tfs_copy_to_external_fs_parallel()
+ */
+typedef struct {
+    int e_inumber; /* the file */
+    int e_shared;  /* handle of the file opened by the caller */
+    int e_dest;    /* descriptor of the destination */
+    size_t e_start, e_end;
+    int e_result;
+} export_part_t;
+
+/* Exports the bytes [e_start, e_end) of a file to the same offsets of the
+ * destination, leaving its holes unwritten */
+static void *export_part(void *arg) {
+    export_part_t *part = (export_part_t *)arg;
+    size_t position_in_file = part->e_start;
+    tfs_view_t view;
+
+    /* A handle of its own keeps the lock and the block map cache of the
+     * handle to the worker; the shared one is used if the open file table
+     * is full */
+    int source = add_to_open_file_table(part->e_inumber, 0, false);
+    bool own = source != -1;
+    if (!own) {
+        source = part->e_shared;
+    }
+
+    part->e_result = 0;
+    while (position_in_file < part->e_end && part->e_result == 0) {
+        ssize_t len = tfs_view(source, (off_t)position_in_file,
+                               part->e_end - position_in_file, &view);
+        if (len <= 0) {
+            /* Stops short if the file was truncated meanwhile */
+            part->e_result = (int)len;
+            break;
+        }
+        size_t at = position_in_file;
+        for (int i = 0; i < view.v_count && part->e_result == 0; i++) {
+            tfs_span_t *span = &view.v_spans[i];
+            if (span->vs_base != NULL) {
+                part->e_result =
+                    pwrite_all(part->e_dest, span->vs_base, span->vs_len, at);
+            }
+            at += span->vs_len;
+        }
+        tfs_view_release(&view);
+        position_in_file += (size_t)len;
+    }
+    if (own && tfs_close(source) == -1) {
+        part->e_result = -1;
+    }
+    return NULL;
+}
+
+int tfs_copy_to_external_fs_parallel(char const *source_path,
+                                     char const *dest_path, int workers) {
+    if (workers < 1) {
+        return -1;
+    }
     int source = tfs_open(source_path, 0);
     if (source == -1) {
         return -1;
     }
+    off_t size = tfs_lseek(source, 0, TFS_SEEK_END);
+    int dest = open(dest_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    /* The destination gets its final size first: each worker writes its
+     * part in place, and the holes of the file are left as holes */
+    if (size == -1 || dest == -1 || ftruncate(dest, size) == -1) {
+        if (dest != -1) {
+            close(dest);
+        }
+        tfs_close(source);
+        return -1;
+    }
+
+    /* Each worker exports a run of whole blocks */
+    size_t blocks = ((size_t)size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if ((size_t)workers > blocks) {
+        workers = (int)blocks;
+    }
+    export_part_t *parts = malloc((size_t)workers * sizeof(export_part_t));
+    pthread_t *threads = malloc((size_t)workers * sizeof(pthread_t));
+    bool *started = calloc((size_t)workers, sizeof(bool));
+    int result = 0;
+    if (workers > 0 && (parts == NULL || threads == NULL || started == NULL)) {
+        result = -1;
+        workers = 0;
+    }
+    for (int i = 0; i < workers; i++) {
+        size_t start = blocks * (size_t)i / (size_t)workers * BLOCK_SIZE;
+        size_t end = blocks * (size_t)(i + 1) / (size_t)workers * BLOCK_SIZE;
+        parts[i].e_inumber = get_open_file_entry(source)->of_inumber;
+        parts[i].e_shared = source;
+        parts[i].e_dest = dest;
+        parts[i].e_start = start;
+        parts[i].e_end = end < (size_t)size ? end : (size_t)size;
+        started[i] =
+            pthread_create(&threads[i], NULL, export_part, &parts[i]) == 0;
+        if (!started[i]) {
+            /* Without a thread for it, the part is exported here */
+            export_part(&parts[i]);
+        }
+    }
+    for (int i = 0; i < workers; i++) {
+        if (started[i] && pthread_join(threads[i], NULL) != 0) {
+            result = -1;
+        }
+        if (parts[i].e_result == -1) {
+            result = -1;
+        }
+    }
+    free(started);
+    free(threads);
+    free(parts);
+
+    if (close(dest) == -1) {
+        result = -1;
+    }
+    if (tfs_close(source) == -1) {
+        result = -1;
+    }
+    return result;
+}
+
+/* Submission and completion rings of the asynchronous interface (see
+ * tfs_submit()). Both are circular arrays, taken by async_mutex. */
+static tfs_sqe_t async_sq[ASYNC_RING_SIZE];
+static tfs_cqe_t async_cq[ASYNC_RING_SIZE];
+static int async_sq_head, async_sq_count;
+static int async_cq_head, async_cq_count;
+/* Operations submitted and not reaped yet: at most ASYNC_RING_SIZE, so
+ * that their completions always fit in the completion ring */
+static int async_inflight;
+static bool async_running;
+/* Set while tfs_async_stop() joins the workers, which still use the rings
+ * and async_threads */
+static bool async_stopping;
+static int async_workers;
+static pthread_t async_threads[ASYNC_MAX_WORKERS];
+static pthread_mutex_t async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_sq_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t async_cq_cond = PTHREAD_COND_INITIALIZER;
 
-    open_file_entry_t *file_source = get_open_file_entry(source);
-    if (file_source == NULL) {
+/* Runs an operation of the asynchronous interface
+ * Returns the result of the call it stands for */
+static ssize_t async_execute(tfs_sqe_t const *sqe) {
+    switch (sqe->sq_op) {
+    case TFS_OP_OPEN:
+        return tfs_open(sqe->sq_name, sqe->sq_flags);
+    case TFS_OP_CLOSE:
+        return tfs_close(sqe->sq_fhandle);
+    case TFS_OP_READ:
+        if (sqe->sq_offset < 0) {
+            return tfs_read(sqe->sq_fhandle, sqe->sq_buffer, sqe->sq_len);
+        }
+        return tfs_pread(sqe->sq_fhandle, sqe->sq_buffer, sqe->sq_len,
+                         sqe->sq_offset);
+    case TFS_OP_WRITE:
+        if (sqe->sq_offset < 0) {
+            return tfs_write(sqe->sq_fhandle, sqe->sq_buffer, sqe->sq_len);
+        }
+        return tfs_pwrite(sqe->sq_fhandle, sqe->sq_buffer, sqe->sq_len,
+                          sqe->sq_offset);
+    default:
         return -1;
     }
+}
 
-    inode_t *inode = inode_get(file_source->of_inumber);
-    if (inode == NULL) {
+/* Worker of the asynchronous interface: runs submitted operations until
+ * the interface is stopped and none is left */
+static void *async_worker(void *arg) {
+    (void)arg;
+    tfs_sqe_t sqe;
+
+    /* Bloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_lock(&async_mutex);
+    for (;;) {
+        while (async_sq_count == 0 && async_running) {
+            pthread_cond_wait(&async_sq_cond, &async_mutex);
+        }
+        if (async_sq_count == 0) {
+            break;
+        }
+        sqe = async_sq[async_sq_head];
+        async_sq_head = (async_sq_head + 1) % ASYNC_RING_SIZE;
+        async_sq_count--;
+        /* Desbloqueia o trinco dos aneis assincronos. */
+        pthread_mutex_unlock(&async_mutex);
+
+        ssize_t result = async_execute(&sqe);
+
+        /* Bloqueia o trinco dos aneis assincronos. */
+        pthread_mutex_lock(&async_mutex);
+        tfs_cqe_t *cqe =
+            &async_cq[(async_cq_head + async_cq_count) % ASYNC_RING_SIZE];
+        cqe->cq_user_data = sqe.sq_user_data;
+        cqe->cq_result = result;
+        async_cq_count++;
+        pthread_cond_broadcast(&async_cq_cond);
+    }
+    /* Desbloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_unlock(&async_mutex);
+    return NULL;
+}
+
+int tfs_async_start(int workers) {
+    if (workers < 1 || workers > ASYNC_MAX_WORKERS) {
         return -1;
     }
-    /* Bloqueia o trinco read write do inode em read. */
-    pthread_rwlock_rdlock(&inode->i_lock);
-    size_t size = inode->i_size;
-    /* Desloqueia o trinco read write do inode. */
-    pthread_rwlock_unlock(&inode->i_lock);
-    char buffer[size]; /* tamanho da array está definido por uma variável */
-    size_t buffer_size = sizeof(buffer); /* Isto já era o size */
 
-    size_t read = (size_t)tfs_read(source, buffer, buffer_size);
-    if (read != size) {
+    /* Bloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_lock(&async_mutex);
+    if (async_running || async_stopping) {
+        /* Desbloqueia o trinco dos aneis assincronos. */
+        pthread_mutex_unlock(&async_mutex);
         return -1;
     }
-    
-    FILE* dest = fopen(dest_path, "w");
-    if (dest == NULL) {
+    async_sq_head = async_sq_count = 0;
+    async_cq_head = async_cq_count = 0;
+    async_inflight = 0;
+    async_running = true;
+    async_workers = 0;
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&async_threads[i], NULL, async_worker, NULL) != 0) {
+            break;
+        }
+        async_workers++;
+    }
+    int result = async_workers == workers ? 0 : -1;
+    /* Desbloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_unlock(&async_mutex);
+
+    if (result == -1) {
+        tfs_async_stop();
+    }
+    return result;
+}
+
+int tfs_async_stop() {
+    /* Bloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_lock(&async_mutex);
+    if (!async_running) {
+        /* Desbloqueia o trinco dos aneis assincronos. */
+        pthread_mutex_unlock(&async_mutex);
         return -1;
     }
-    if (fwrite(buffer, 1, read, dest) != size) {
+    async_running = false;
+    async_stopping = true;
+    pthread_cond_broadcast(&async_sq_cond);
+    int workers = async_workers;
+    /* Desbloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_unlock(&async_mutex);
+
+    /* The workers finish the operations already submitted first */
+    int result = 0;
+    for (int i = 0; i < workers; i++) {
+        if (pthread_join(async_threads[i], NULL) != 0) {
+            result = -1;
+        }
+    }
+
+    /* Bloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_lock(&async_mutex);
+    async_stopping = false;
+    /* Desbloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_unlock(&async_mutex);
+    return result;
+}
+
+int tfs_submit(tfs_sqe_t const *sqes, int count) {
+    if (count < 0) {
         return -1;
     }
-    fclose(dest);
-    if (tfs_close(source) == -1) {
+    /* The entries are copied whole, so a name must end within sq_name */
+    for (int i = 0; i < count; i++) {
+        if (sqes[i].sq_op == TFS_OP_OPEN &&
+            strnlen(sqes[i].sq_name, MAX_FILE_NAME) == MAX_FILE_NAME) {
+            return -1;
+        }
+    }
+
+    /* Bloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_lock(&async_mutex);
+    if (!async_running) {
+        /* Desbloqueia o trinco dos aneis assincronos. */
+        pthread_mutex_unlock(&async_mutex);
         return -1;
     }
-    return 0;
-}
\ No newline at end of file
+    int submitted = 0;
+    while (submitted < count && async_inflight < ASYNC_RING_SIZE) {
+        async_sq[(async_sq_head + async_sq_count) % ASYNC_RING_SIZE] =
+            sqes[submitted++];
+        async_sq_count++;
+        async_inflight++;
+    }
+    if (submitted > 0) {
+        pthread_cond_broadcast(&async_sq_cond);
+    }
+    /* Desbloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_unlock(&async_mutex);
+    return submitted;
+}
+
+int tfs_reap(tfs_cqe_t *cqes, int max, int min_complete) {
+    if (max < 0 || min_complete < 0 || min_complete > max) {
+        return -1;
+    }
+
+    /* Bloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_lock(&async_mutex);
+    /* Waits for min_complete completions, unless fewer operations are in
+     * flight (they would never come) */
+    while (async_cq_count < min_complete && async_cq_count < async_inflight) {
+        pthread_cond_wait(&async_cq_cond, &async_mutex);
+    }
+    int reaped = 0;
+    while (reaped < max && async_cq_count > 0) {
+        cqes[reaped++] = async_cq[async_cq_head];
+        async_cq_head = (async_cq_head + 1) % ASYNC_RING_SIZE;
+        async_cq_count--;
+        async_inflight--;
+    }
+    /* Desbloqueia o trinco dos aneis assincronos. */
+    pthread_mutex_unlock(&async_mutex);
+    return reaped;
+}
@@ -3,7 +3,9 @@
 
 #include "config.h"
 #include "state.h"
+#include <stdint.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <pthread.h>
 
 enum {
@@ -12,6 +14,66 @@ enum {
     TFS_O_APPEND = 0b100,
 };
 
+/* tfs_lseek whence values */
+enum {
+    TFS_SEEK_SET = 0,
+    TFS_SEEK_CUR = 1,
+    TFS_SEEK_END = 2,
+};
+
+/* Bytes of a read view, stored contiguously in memory */
+typedef struct {
+    void const *vs_base; /* NULL for a hole, which reads as zeros */
+    size_t vs_len;
+} tfs_span_t;
+
+/* Read-only view of a part of a file (see tfs_view()) */
+typedef struct {
+    inode_t *v_inode;
+    int v_range; /* the range lock that pins the bytes */
+    int v_count; /* spans used */
+    tfs_span_t v_spans[VIEW_SPANS];
+} tfs_view_t;
+
+/* Mapping of a part of a file into memory (see tfs_map()) */
+typedef struct {
+    open_file_entry_t *m_file;
+    inode_t *m_inode;
+    int m_range; /* the range lock that holds the bytes */
+    size_t m_position;
+    size_t m_len;
+    char *m_data;   /* the mapped bytes */
+    char *m_buffer; /* a copy of them, written back on release, or NULL
+                     * when they are mapped in place */
+} tfs_map_t;
+
+/* Operations of the asynchronous interface (see tfs_submit()) */
+enum {
+    TFS_OP_OPEN = 0,
+    TFS_OP_CLOSE = 1,
+    TFS_OP_READ = 2,
+    TFS_OP_WRITE = 3,
+};
+
+/* Submission queue entry: an operation and its arguments */
+typedef struct {
+    int sq_op;
+    char sq_name[MAX_FILE_NAME]; /* TFS_OP_OPEN */
+    int sq_flags;                /* TFS_OP_OPEN */
+    int sq_fhandle;              /* all but TFS_OP_OPEN */
+    void *sq_buffer;             /* TFS_OP_READ and TFS_OP_WRITE */
+    size_t sq_len;               /* TFS_OP_READ and TFS_OP_WRITE */
+    off_t sq_offset; /* TFS_OP_READ and TFS_OP_WRITE: where in the file, or
+                      * -1 for the handle's offset */
+    uint64_t sq_user_data; /* given back in the completion */
+} tfs_sqe_t;
+
+/* Completion queue entry: the result of a submitted operation */
+typedef struct {
+    uint64_t cq_user_data;
+    ssize_t cq_result; /* what the blocking call returns */
+} tfs_cqe_t;
+
 /*
  * Initializes tecnicofs
  * Returns 0 if successful, -1 otherwise.
@@ -32,14 +94,21 @@ int tfs_destroy_after_all_closed();
 
 
 /*
- * Looks for a file
- * Note: as a simplification, only a plain directory space (root directory only)
- * is supported Input:
- *  - name: absolute path name
+ * Looks for a file or directory
+ * Input:
+ *  - name: absolute path name (e.g. /dir/subdir/file)
  * Returns the inumber of the file, -1 if unsuccessful
  */
 int tfs_lookup(char const *name);
 
+/*
+ * Creates a directory
+ * Input:
+ *  - name: absolute path name; its parent directory must already exist
+ * Returns 0 if successful, -1 otherwise (including if the name is taken)
+ */
+int tfs_mkdir(char const *name);
+
 /*
  * Opens a file
  * Input:
@@ -48,6 +117,7 @@ int tfs_lookup(char const *name);
  *    - append mode (TFS_O_APPEND)
  *    - truncate file contents (TFS_O_TRUNC)
  *    - create file if it does not exist (TFS_O_CREAT)
+ * Directories cannot be opened.
  */
 int tfs_open(char const *name, int flags);
 
@@ -58,13 +128,18 @@ int tfs_open(char const *name, int flags);
  */
 int tfs_close(int fhandle);
 
-/* Writes to an open file, starting at the current offset
+/* Writes to an open file, starting at the current offset (or, for handles
+ * opened with TFS_O_APPEND, at the end of the file: concurrent appends, even
+ * through different handles, never overwrite each other; an append cut
+ * short by a full disk leaves the file ending where it stopped, unless
+ * another append already went after it, which then follows a hole)
  * Input:
  * 	- file handle (obtained from a previous call to tfs_open)
  * 	- buffer containing the contents to write
  * 	- length of the contents (in bytes)
  * 	Returns the number of bytes that were written (can be lower than
- * 	'len' if the maximum file size is exceeded), or -1 in case of error
+ * 	'len' if the maximum file size is exceeded or the disk is full), or -1
+ * 	in case of error
  */
 ssize_t tfs_write(int fhandle, void const *buffer, size_t len);
 
@@ -79,6 +154,120 @@ ssize_t tfs_write(int fhandle, void const *buffer, size_t len);
  */
 ssize_t tfs_read(int fhandle, void *buffer, size_t len);
 
+/* Writes to an open file at a given offset, without using or moving the
+ * handle's offset (so that threads sharing a handle can write different
+ * parts of the file), even for handles opened with TFS_O_APPEND
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- buffer containing the contents to write
+ * 	- length of the contents (in bytes)
+ * 	- offset in the file to write at
+ * 	Returns as tfs_write(), and -1 if the offset is negative
+ */
+ssize_t tfs_pwrite(int fhandle, void const *buffer, size_t len, off_t offset);
+
+/* Reads from an open file at a given offset, without using or moving the
+ * handle's offset
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- destination buffer
+ * 	- length of the buffer
+ * 	- offset in the file to read from
+ * 	Returns as tfs_read(), and -1 if the offset is negative
+ */
+ssize_t tfs_pread(int fhandle, void *buffer, size_t len, off_t offset);
+
+/* Writes the contents of several buffers, one after the other, to an open
+ * file, as a single tfs_write() (the file is looked up and locked once)
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- array of buffers (base and length of each one)
+ * 	- number of buffers
+ * 	Returns as tfs_write(), and -1 if the number of buffers is negative or
+ * 	their total length does not fit in a ssize_t
+ */
+ssize_t tfs_writev(int fhandle, struct iovec const *iov, int iovcnt);
+
+/* Reads from an open file into several buffers, filling each one before
+ * the next, as a single tfs_read() (the file is looked up and locked once)
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- array of buffers (base and length of each one)
+ * 	- number of buffers
+ * 	Returns as tfs_read(), and -1 if the number of buffers is negative or
+ * 	their total length does not fit in a ssize_t
+ */
+ssize_t tfs_readv(int fhandle, struct iovec const *iov, int iovcnt);
+
+/* Gives direct, read-only access to a part of an open file, without
+ * copying it and without using or moving the handle's offset. The bytes
+ * are listed, in order, as spans of the memory that stores them, and stay
+ * there unchanged (writes to them and truncations of the file wait) until
+ * the view is released with tfs_view_release().
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- offset in the file where the view starts
+ * 	- length of the view (in bytes)
+ * 	- the view to fill in
+ * 	Returns the number of bytes in the view (can be lower than 'len' if the
+ * 	file size was reached, or if they are stored in more than VIEW_SPANS
+ * 	runs), or -1 in case of error (including a negative offset)
+ */
+ssize_t tfs_view(int fhandle, off_t offset, size_t len, tfs_view_t *view);
+
+/* Releases a view filled in by tfs_view() (a view with no bytes, or one
+ * that failed, may be released too)
+ * Input:
+ * 	- the view
+ */
+void tfs_view_release(tfs_view_t *view);
+
+/* Maps a part of an open file to contiguous memory, to be read and
+ * written without further calls, and without using or moving the handle's
+ * offset. When the file stores those bytes contiguously, the memory is
+ * theirs; otherwise it holds a copy of them, written back when the mapping
+ * is released. Either way, other reads and writes of those bytes, and
+ * truncations of the file, wait until tfs_unmap() is called. While the
+ * mapping is held, reads of any part of the file also take the i-node's
+ * locks, rather than reading without them (see inode_read_seq()): keep
+ * mappings short-lived.
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- offset in the file where the mapping starts
+ * 	- length of the mapping (in bytes; cut at MAX_FILE_SIZE)
+ * 	- the mapping to fill in
+ * 	Bytes past the end of the file map to zeros, and the file grows to
+ * 	cover the bytes written when the mapping is released.
+ * 	Returns a pointer to the mapped bytes, or NULL in case of error
+ * 	(including a negative offset and an empty mapping)
+ */
+void *tfs_map(int fhandle, off_t offset, size_t len, tfs_map_t *map);
+
+/* Releases a mapping made by tfs_map(), saving what was written to it
+ * Input:
+ * 	- the mapping
+ * 	- how many bytes, from the start of the mapping, may have been
+ * 	  written (0 when it was only read): later bytes are not saved, and
+ * 	  the file grows to cover these bytes only. Holes of the file that
+ * 	  are still zeros are not filled in.
+ * 	Returns 0 if successful, -1 if the bytes could not all be written back
+ * 	(when the disk is full)
+ */
+int tfs_unmap(tfs_map_t *map, size_t written);
+
+/* Moves the offset of an open file
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- offset (in bytes), relative to the position given by whence
+ * 	- whence: TFS_SEEK_SET (start of the file), TFS_SEEK_CUR (current
+ * 	  offset) or TFS_SEEK_END (end of the file)
+ * 	The offset may go past the end of the file: a write there leaves a hole
+ * 	(which reads as zeros and takes no data blocks) before the written bytes.
+ * 	Returns the new offset from the start of the file, or -1 in case of
+ * 	error (including offsets before the start or after MAX_FILE_SIZE)
+ */
+off_t tfs_lseek(int fhandle, off_t offset, int whence);
+
 /* Copies the contents of a file that exists in TecnicoFS to the contents
  * of another file in the OS' file system tree (outside TecnicoFS).
  * Devolve 0 em caso de sucesso, -1 em caso de erro.
@@ -90,4 +279,78 @@ ssize_t tfs_read(int fhandle, void *buffer, size_t len);
 */ 
 int tfs_copy_to_external_fs(char const *source_path, char const *dest_path);
 
+/* Copies the contents of a file in the OS' file system tree (outside
+ * TecnicoFS) to the contents of a file in TecnicoFS, in a single write
+ * (the blocks it needs are allocated at once).
+ * Input:
+ *      - path name of the source file (in the main file system), which
+ *        must be a regular file of at most MAX_FILE_SIZE bytes
+ *      - path name of the destination file (in TecnicoFS), which is
+ *        created if needed, and truncated if it already exists
+ *      Returns 0 if successful, -1 otherwise (including when the disk is
+ *      full).
+ */
+int tfs_copy_from_external_fs(char const *source_path, char const *dest_path);
+
+/* Copies the contents of a file that exists in TecnicoFS to the contents
+ * of another file in the OS' file system tree, as tfs_copy_to_external_fs(),
+ * with several threads. The file is split in runs of blocks, one per
+ * thread, that are written in place to the destination, which is given
+ * the file's size first (so it must be a regular file). Each thread opens
+ * the file for itself while there is room in the open file table.
+ * Input:
+ *      - path name of the source file (from TecnicoFS)
+ *      - path name of the destination file (in the main file system), which
+ *        is created if needed, and overwritten if it already exists
+ *      - number of threads (at most one per block of the file is used)
+ *      Returns 0 if successful, -1 otherwise (including less than one
+ *      thread).
+ */
+int tfs_copy_to_external_fs_parallel(char const *source_path,
+                                     char const *dest_path, int workers);
+
+/* Starts the asynchronous interface: a pool of threads that run the
+ * operations given to tfs_submit() (after tfs_init())
+ * Input:
+ *      - number of threads (1 to ASYNC_MAX_WORKERS)
+ *      Returns 0 if successful, -1 otherwise (including when it is already
+ *      started, or still being stopped by tfs_async_stop()).
+ */
+int tfs_async_start(int workers);
+
+/* Stops the asynchronous interface, once the operations already submitted
+ * have run (before tfs_destroy()). Completions not reaped are dropped.
+ *      Returns 0 if successful, -1 otherwise (including when it is not
+ *      started).
+ */
+int tfs_async_stop();
+
+/* Submits operations to run asynchronously, without waiting for them.
+ * Operations run in any order and in parallel, so operations that depend
+ * on each other (such as an open and the writes to its handle, or reads
+ * and writes at a shared handle's offset) must wait for each other's
+ * completions.
+ * Input:
+ *      - array of submission queue entries (copied, path names of opens
+ *        included: they may be reused once submitted; buffers may not,
+ *        until completed)
+ *      - number of entries
+ *      Returns the number of entries submitted, which is lower than the
+ *      number given when ASYNC_RING_SIZE operations would be in flight
+ *      (submitted and not reaped), or -1 in case of error (including when
+ *      the interface is not started, or when the path name of an open
+ *      does not fit in sq_name, in which case nothing is submitted).
+ */
+int tfs_submit(tfs_sqe_t const *sqes, int count);
+
+/* Collects completions of submitted operations, in the order they ended.
+ * Input:
+ *      - array of completion queue entries to fill in
+ *      - its size
+ *      - how many completions to wait for (fewer when fewer operations
+ *        are in flight)
+ *      Returns the number of completions collected, or -1 in case of error
+ */
+int tfs_reap(tfs_cqe_t *cqes, int max, int min_complete);
+
 #endif // OPERATIONS_H
@@ -1,6 +1,9 @@
 #include "state.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,18 +16,61 @@
 /* I-node table */
 static pthread_mutex_t it_mutex; /* trinco mutex para i-node table */
 static inode_t inode_table[INODE_TABLE_SIZE];
-static char freeinode_ts[INODE_TABLE_SIZE];
+/* Free i-node bitmap, with the same layout as free_blocks */
+static _Atomic uint64_t freeinode_ts[INODE_BITMAP_WORDS];
 
 /* Data blocks */
 static pthread_mutex_t db_mutex; /* trinco mutex para data blocks */
 static char fs_data[BLOCK_SIZE * DATA_BLOCKS];
-static char free_blocks[DATA_BLOCKS];
+/* Free block bitmap: bit (i % 64) of word (i / 64) is set iff block i is
+ * TAKEN, so a full word can be skipped with a single comparison */
+static _Atomic uint64_t free_blocks[BITMAP_WORDS];
+
+#ifndef TFS_ALLOC_MUTEX
+/* Lock-free allocation: each thread starts scanning free_blocks at its own
+ * word (spread by thread arrival order) and keeps going from the last word
+ * where it found a free block, so concurrent claims rarely race on a word */
+static atomic_uint alloc_threads;
+static _Thread_local size_t alloc_hint = SIZE_MAX;
+#endif
+
+/* Per-thread block magazines: each thread keeps a small stack of blocks that
+ * are already taken in free_blocks. Allocations pop from it and frees push
+ * to it, so only refills and drains (MAGAZINE_BATCH blocks at a time) reach
+ * the global table. Blocks sitting in a magazine count as taken, so the
+ * disk may report full while other threads still hold a few reserved
+ * blocks (a thread's own go back before it is refused a run). */
+typedef struct {
+    unsigned int m_epoch; /* FS instance the reserved blocks belong to */
+    int m_count;
+    int m_blocks[MAGAZINE_SIZE];
+} magazine_t;
+
+static pthread_key_t magazine_key;
+static pthread_once_t magazine_key_once = PTHREAD_ONCE_INIT;
+/* Bumped by state_init() and state_destroy(), so that magazines filled by a
+ * previous FS instance are discarded instead of released */
+static atomic_uint magazine_epoch;
 
 /* Volatile FS state */
 static pthread_mutex_t vs_mutex; /* trinco mutex para volatile state */
 static open_file_entry_t open_file_table[MAX_OPEN_FILES];
 static char free_open_file_entries[MAX_OPEN_FILES];
 
+/* Dentry cache: the i-nodes of directory entries recently found or added,
+ * by (parent directory, name), so that walking a path skips find_in_dir()
+ * for the components seen before. Only existing names are cached, and
+ * clear_dir_entry() drops them. */
+typedef struct {
+    int dc_parent;
+    int dc_inumber; /* EMPTY if the slot is free */
+    uint32_t dc_hash;
+    char dc_name[MAX_FILE_NAME];
+} dentry_t;
+
+static pthread_rwlock_t dc_lock; /* trinco read write para dentry cache */
+static dentry_t dentry_cache[DENTRY_CACHE_SIZE];
+
 static inline bool valid_inumber(int inumber) {
     return inumber >= 0 && inumber < INODE_TABLE_SIZE;
 }
@@ -65,33 +111,485 @@ static void insert_delay() {
 }
 
 /*
- * Initializes FS state
+ * Marks every bit of a bitmap as free, except the padding bits past the last
+ * valid index (when the size is not a multiple of 64), which are kept taken
+ * so that they are never handed out.
+ * Input:
+ *  - bitmap: the bitmap to reset
+ *  - words: number of words in the bitmap
+ *  - size: number of valid indexes
  */
-void state_init() {
-    for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
-        freeinode_ts[i] = FREE;
+static void bitmap_reset(_Atomic uint64_t *bitmap, size_t words, int size) {
+    for (size_t w = 0; w < words; w++) {
+        atomic_init(&bitmap[w], 0);
+    }
+    if (size % BITMAP_WORD_BITS != 0) {
+        atomic_init(&bitmap[words - 1], ~(uint64_t)0
+                                            << (size % BITMAP_WORD_BITS));
+    }
+}
+
+/*
+ * Picks up to n of the free (zero) bits of a bitmap word, lowest first.
+ * Returns: mask with the picked bits set
+ */
+static uint64_t lowest_free_bits(uint64_t word, int n) {
+    uint64_t free_bits = ~word;
+    uint64_t mask = 0;
+
+    for (int i = 0; i < n && free_bits != 0; i++) {
+        mask |= free_bits & -free_bits;
+        free_bits &= free_bits - 1;
+    }
+    return mask;
+}
+
+/*
+ * Writes the indexes of the bits set in a mask of word w to an array.
+ * Returns: number of indexes written
+ */
+static int mask_to_indexes(size_t w, uint64_t mask, int *indexes) {
+    int count = 0;
+
+    while (mask != 0) {
+        indexes[count++] = (int)w * BITMAP_WORD_BITS + __builtin_ctzll(mask);
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+/*
+ * Claims up to n free bits of a bitmap, starting at a given word and
+ * wrapping around. Free bits are taken a whole word at a time, so a batch
+ * usually costs a single update.
+ * With TFS_ALLOC_MUTEX the scan is made under the given mutex (always from
+ * the first word); otherwise the bits are claimed with a compare-and-swap on
+ * their word.
+ * Input:
+ *  - bitmap: the bitmap to claim from
+ *  - words: number of words in the bitmap
+ *  - start: index of the first word to scan
+ *  - mutex: lock protecting the bitmap in mutex mode
+ *  - indexes: array where the claimed indexes are stored, in ascending order
+ *    within each word
+ *  - n: maximum number of indexes to claim
+ * Returns: number of claimed indexes (0 if every bit is taken)
+ */
+static int bitmap_claim_batch(_Atomic uint64_t *bitmap, size_t words,
+                              size_t start, pthread_mutex_t *mutex,
+                              int *indexes, int n) {
+    int claimed = 0;
+
+#ifdef TFS_ALLOC_MUTEX
+    (void)start;
+    /* Bloqueia o trinco do bitmap. */
+    pthread_mutex_lock(mutex);
+    for (size_t w = 0; w < words && claimed < n; w++) {
+        /* Skips words with every bit taken */
+        uint64_t word = atomic_load_explicit(&bitmap[w], memory_order_relaxed);
+        if (word != ~(uint64_t)0) {
+            uint64_t mask = lowest_free_bits(word, n - claimed);
+            atomic_store_explicit(&bitmap[w], word | mask,
+                                  memory_order_relaxed);
+            claimed += mask_to_indexes(w, mask, indexes + claimed);
+        }
+    }
+    /* Desbloqueia o trinco do bitmap. */
+    pthread_mutex_unlock(mutex);
+#else
+    (void)mutex;
+    for (size_t i = 0; i < words && claimed < n; i++) {
+        size_t w = (start + i) % words;
+        uint64_t word = atomic_load_explicit(&bitmap[w], memory_order_relaxed);
+        /* A failed CAS reloads the word, so the loop retries with the bits
+         * that are still free until the word fills up */
+        while (word != ~(uint64_t)0) {
+            uint64_t mask = lowest_free_bits(word, n - claimed);
+            if (atomic_compare_exchange_weak_explicit(
+                    &bitmap[w], &word, word | mask, memory_order_acquire,
+                    memory_order_relaxed)) {
+                claimed += mask_to_indexes(w, mask, indexes + claimed);
+                break;
+            }
+        }
+    }
+#endif
+    return claimed;
+}
+
+/*
+ * Claims the first free bit of a bitmap (see bitmap_claim_batch()).
+ * Returns: claimed index if successful, -1 if every bit is taken
+ */
+static int bitmap_claim(_Atomic uint64_t *bitmap, size_t words, size_t start,
+                        pthread_mutex_t *mutex) {
+    int index;
+    if (bitmap_claim_batch(bitmap, words, start, mutex, &index, 1) == 0) {
+        return -1;
+    }
+    return index;
+}
+
+/*
+ * Releases n indexes previously claimed from a bitmap.
+ * Input:
+ *  - bitmap: the bitmap to release into
+ *  - indexes: the indexes to release
+ *  - n: number of indexes
+ *  - mutex: lock protecting the bitmap in mutex mode
+ */
+static void bitmap_release_batch(_Atomic uint64_t *bitmap, int const *indexes,
+                                 int n, pthread_mutex_t *mutex) {
+#ifdef TFS_ALLOC_MUTEX
+    /* Bloqueia o trinco do bitmap. */
+    pthread_mutex_lock(mutex);
+#else
+    (void)mutex;
+#endif
+    for (int i = 0; i < n; i++) {
+        uint64_t mask = ~((uint64_t)1 << (indexes[i] % BITMAP_WORD_BITS));
+        atomic_fetch_and_explicit(&bitmap[indexes[i] / BITMAP_WORD_BITS], mask,
+                                  memory_order_release);
+    }
+#ifdef TFS_ALLOC_MUTEX
+    /* Desbloqueia o trinco do bitmap. */
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+/*
+ * Releases an index previously claimed from a bitmap.
+ */
+static void bitmap_release(_Atomic uint64_t *bitmap, int index,
+                           pthread_mutex_t *mutex) {
+    bitmap_release_batch(bitmap, &index, 1, mutex);
+}
+
+/*
+ * Claims the free bits of a bitmap that follow a given index, stopping at
+ * the first taken bit.
+ * Input:
+ *  - bitmap: the bitmap to claim from
+ *  - words: number of words in the bitmap
+ *  - first: index of the first bit of the run
+ *  - n: maximum number of bits to claim
+ *  - mutex: lock protecting the bitmap in mutex mode
+ * Returns: number of claimed bits (indexes first .. first + result - 1)
+ */
+static int bitmap_claim_run(_Atomic uint64_t *bitmap, size_t words, int first,
+                            int n, pthread_mutex_t *mutex) {
+    int claimed = 0;
+
+#ifdef TFS_ALLOC_MUTEX
+    /* Bloqueia o trinco do bitmap. */
+    pthread_mutex_lock(mutex);
+#else
+    (void)mutex;
+#endif
+    while (claimed < n && (size_t)(first + claimed) / BITMAP_WORD_BITS < words) {
+        size_t w = (size_t)(first + claimed) / BITMAP_WORD_BITS;
+        int bit = (first + claimed) % BITMAP_WORD_BITS;
+        int want = n - claimed;
+        int len;
+        uint64_t word = atomic_load_explicit(&bitmap[w], memory_order_relaxed);
+
+        for (;;) {
+            /* Length of the run of free bits starting at bit */
+            uint64_t taken = word >> bit;
+            len = taken == 0 ? BITMAP_WORD_BITS - bit : __builtin_ctzll(taken);
+            if (len > want) {
+                len = want;
+            }
+            if (len == 0) {
+                break;
+            }
+            uint64_t mask = (len == BITMAP_WORD_BITS
+                                 ? ~(uint64_t)0
+                                 : ((uint64_t)1 << len) - 1)
+                            << bit;
+#ifdef TFS_ALLOC_MUTEX
+            atomic_store_explicit(&bitmap[w], word | mask,
+                                  memory_order_relaxed);
+            break;
+#else
+            if (atomic_compare_exchange_weak_explicit(
+                    &bitmap[w], &word, word | mask, memory_order_acquire,
+                    memory_order_relaxed)) {
+                break;
+            }
+#endif
+        }
+        claimed += len;
+        /* The run only continues into the next word if it reached the end
+         * of this one */
+        if (len == 0 || bit + len < BITMAP_WORD_BITS) {
+            break;
+        }
+    }
+#ifdef TFS_ALLOC_MUTEX
+    /* Desbloqueia o trinco do bitmap. */
+    pthread_mutex_unlock(mutex);
+#endif
+    return claimed;
+}
+
+/*
+ * Finds where a run of n free bits can start: the first free bit (scanning
+ * from a given word and wrapping around) whose run of free bits is at least
+ * n long or reaches the end of its word. Falls back to the first free bit.
+ * The bits are not claimed, so the caller may lose them to another thread.
+ * Returns: index of the first bit of the run, -1 if every bit is taken
+ */
+static int bitmap_find_run(_Atomic uint64_t *bitmap, size_t words,
+                           size_t start, int n) {
+    int first_free = -1;
+
+    for (size_t i = 0; i < words; i++) {
+        size_t w = (start + i) % words;
+        uint64_t free_bits =
+            ~atomic_load_explicit(&bitmap[w], memory_order_relaxed);
+
+        while (free_bits != 0) {
+            int bit = __builtin_ctzll(free_bits);
+            uint64_t rest = ~(free_bits >> bit);
+            int len = rest == 0 ? BITMAP_WORD_BITS - bit : __builtin_ctzll(rest);
+            if (first_free == -1) {
+                first_free = (int)w * BITMAP_WORD_BITS + bit;
+            }
+            if (len >= n || bit + len == BITMAP_WORD_BITS) {
+                return (int)w * BITMAP_WORD_BITS + bit;
+            }
+            /* Skips this (too short) run */
+            free_bits &= ~((((uint64_t)1 << len) - 1) << bit);
+        }
+    }
+    return first_free;
+}
+
+/*
+ * Releases the indexes first .. first + n - 1 of a bitmap, one word at a
+ * time.
+ */
+static void bitmap_release_run(_Atomic uint64_t *bitmap, int first, int n,
+                               pthread_mutex_t *mutex) {
+#ifdef TFS_ALLOC_MUTEX
+    /* Bloqueia o trinco do bitmap. */
+    pthread_mutex_lock(mutex);
+#else
+    (void)mutex;
+#endif
+    while (n > 0) {
+        int bit = first % BITMAP_WORD_BITS;
+        int len = BITMAP_WORD_BITS - bit < n ? BITMAP_WORD_BITS - bit : n;
+        uint64_t mask = (len == BITMAP_WORD_BITS ? ~(uint64_t)0
+                                                 : ((uint64_t)1 << len) - 1)
+                        << bit;
+        atomic_fetch_and_explicit(&bitmap[first / BITMAP_WORD_BITS], ~mask,
+                                  memory_order_release);
+        first += len;
+        n -= len;
+    }
+#ifdef TFS_ALLOC_MUTEX
+    /* Desbloqueia o trinco do bitmap. */
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+/*
+ * Checks whether an index of a bitmap is taken.
+ */
+static bool bitmap_taken(_Atomic uint64_t *bitmap, int index) {
+    uint64_t word = atomic_load_explicit(&bitmap[index / BITMAP_WORD_BITS],
+                                         memory_order_acquire);
+    return (word >> (index % BITMAP_WORD_BITS)) & 1;
+}
+
+/*
+ * Returns the word where the calling thread starts looking for free blocks.
+ */
+static size_t block_alloc_start() {
+#ifdef TFS_ALLOC_MUTEX
+    return 0;
+#else
+    if (alloc_hint == SIZE_MAX) {
+        alloc_hint = atomic_fetch_add(&alloc_threads, 1) % BITMAP_WORDS;
+    }
+    return alloc_hint;
+#endif
+}
+
+/*
+ * Thread exit destructor: returns the blocks of the magazine to free_blocks.
+ */
+static void magazine_destroy(void *arg) {
+    magazine_t *mag = (magazine_t *)arg;
+
+    if (mag->m_epoch == atomic_load(&magazine_epoch)) {
+        bitmap_release_batch(free_blocks, mag->m_blocks, mag->m_count,
+                             &db_mutex);
+    }
+    free(mag);
+}
+
+static void magazine_key_create() {
+    pthread_key_create(&magazine_key, magazine_destroy);
+}
+
+/*
+ * Returns the calling thread's magazine, creating it on first use.
+ * Returns: pointer to the magazine, NULL if it could not be created
+ */
+static magazine_t *magazine_get() {
+    unsigned int epoch = atomic_load(&magazine_epoch);
+    magazine_t *mag = (magazine_t *)pthread_getspecific(magazine_key);
+
+    if (mag == NULL) {
+        mag = (magazine_t *)malloc(sizeof(magazine_t));
+        if (mag == NULL) {
+            return NULL;
+        }
+        if (pthread_setspecific(magazine_key, mag) != 0) {
+            free(mag);
+            return NULL;
+        }
+        mag->m_count = 0;
+        mag->m_epoch = epoch;
+    } else if (mag->m_epoch != epoch) {
+        /* The blocks belong to a previous FS instance */
+        mag->m_count = 0;
+        mag->m_epoch = epoch;
+    }
+    return mag;
+}
+
+/*
+ * Returns the blocks of the calling thread's magazine to free_blocks.
+ * Returns: true if there were any
+ */
+static bool magazine_drain() {
+    magazine_t *mag = (magazine_t *)pthread_getspecific(magazine_key);
+
+    if (mag == NULL || mag->m_count == 0 ||
+        mag->m_epoch != atomic_load(&magazine_epoch)) {
+        return false;
+    }
+    insert_delay(); // simulate storage access delay to free_blocks
+    bitmap_release_batch(free_blocks, mag->m_blocks, mag->m_count,
+                         &db_mutex);
+    mag->m_count = 0;
+    return true;
+}
+
+/*
+ * Allocates up to n contiguous data blocks starting exactly at a given
+ * block (used to grow an extent in place).
+ * Returns: number of blocks allocated (0 if the first one is taken)
+ */
+static int data_block_alloc_at(int first, int n) {
+    if (!valid_block_number(first)) {
+        return 0;
     }
+    insert_delay(); // simulate storage access delay to free_blocks
+    return bitmap_claim_run(free_blocks, BITMAP_WORDS, first, n, &db_mutex);
+}
 
-    for (size_t i = 0; i < DATA_BLOCKS; i++) {
-        free_blocks[i] = FREE;
+/*
+ * Allocates up to n contiguous data blocks wherever a long enough run of
+ * free blocks is found (or the longest first run otherwise). These blocks do
+ * not go through the thread's magazine.
+ * Input:
+ *  - n: number of blocks wanted
+ *  - first: set to the first allocated block
+ * Returns: number of blocks allocated, 0 if the disk is full
+ */
+static int data_block_alloc_run(int n, int *first) {
+    /* Retries if another thread takes the run between the two steps */
+    for (int attempt = 0; attempt < 3; attempt++) {
+        insert_delay(); // simulate storage access delay to free_blocks
+        int start = bitmap_find_run(free_blocks, BITMAP_WORDS,
+                                    block_alloc_start(), n);
+        if (start == -1) {
+            /* The blocks this thread keeps in its magazine may be the
+             * ones missing */
+            if (magazine_drain()) {
+                continue;
+            }
+            return 0;
+        }
+        int got =
+            bitmap_claim_run(free_blocks, BITMAP_WORDS, start, n, &db_mutex);
+        if (got > 0) {
+            *first = start;
+            return got;
+        }
     }
+    return 0;
+}
+
+/*
+ * Frees a run of contiguous data blocks straight into free_blocks, so that
+ * the run stays available for other extents.
+ */
+static void data_block_free_run(int first, int n) {
+    insert_delay(); // simulate storage access delay to free_blocks
+    bitmap_release_run(free_blocks, first, n, &db_mutex);
+}
+
+static int pointer_trees_free(inode_t *inode, bool data);
+static int dir_init(inode_t *inode);
+static void dir_bloom_free(inode_t *inode);
+
+/*
+ * Initializes FS state
+ */
+void state_init() {
+    bitmap_reset(freeinode_ts, INODE_BITMAP_WORDS, INODE_TABLE_SIZE);
+    bitmap_reset(free_blocks, BITMAP_WORDS, DATA_BLOCKS);
 
     for (size_t i = 0; i < MAX_OPEN_FILES; i++) {
         free_open_file_entries[i] = FREE;
     }
 
+    for (size_t i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        dentry_cache[i].dc_inumber = EMPTY;
+    }
+    /* Bloom filters left by a previous FS instance */
+    for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
+        dir_bloom_free(&inode_table[i]);
+        range_lock_t *lock = &inode_table[i].i_range_lock;
+        pthread_mutex_init(&lock->rl_mutex, NULL);
+        pthread_cond_init(&lock->rl_cond, NULL);
+        for (size_t r = 0; r < RANGE_LOCK_SLOTS; r++) {
+            lock->rl_ranges[r].r_used = false;
+        }
+    }
+
     /* Inicializa todos os trincos em state.c */
     pthread_mutex_init(&it_mutex, NULL);
     pthread_mutex_init(&db_mutex, NULL);
     pthread_mutex_init(&vs_mutex, NULL);
+    pthread_rwlock_init(&dc_lock, NULL);
+
+    pthread_once(&magazine_key_once, magazine_key_create);
+    atomic_fetch_add(&magazine_epoch, 1);
 
 }
 
 void state_destroy() { /* nothing to do */
+/* The destroying thread's blocks go back; those of other magazines still
+ * alive are discarded, as they must not touch free_blocks from now on */
+magazine_drain();
+atomic_fetch_add(&magazine_epoch, 1);
 /* Destrói todos os trincos */
 pthread_mutex_destroy(&it_mutex);
 pthread_mutex_destroy(&db_mutex);
 pthread_mutex_destroy(&vs_mutex);
+pthread_rwlock_destroy(&dc_lock);
+for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
+    dir_bloom_free(&inode_table[i]);
+    pthread_mutex_destroy(&inode_table[i].i_range_lock.rl_mutex);
+    pthread_cond_destroy(&inode_table[i].i_range_lock.rl_cond);
+}
 }
 
 /*
@@ -102,68 +600,49 @@ pthread_mutex_destroy(&vs_mutex);
  *  new i-node's number if successfully created, -1 otherwise
  */
 int inode_create(inode_type n_type) {
-    for (int inumber = 0; inumber < INODE_TABLE_SIZE; inumber++) {
-        if ((inumber * (int) sizeof(allocation_state_t)) == 0) {
-            insert_delay(); // simulate storage access delay (to freeinode_ts)
-        }
-        /* Bloqueia o trinco da tabela de inodes. */
-        pthread_mutex_lock(&it_mutex);
-        /* Finds first free entry in i-node table */
-        if (freeinode_ts[inumber] == FREE) {
-            /* Found a free entry, so takes it for the new i-node*/
-            freeinode_ts[inumber] = TAKEN;
-            /* Desbloqueia o trinco da tabela de inodes. */
-            pthread_mutex_unlock(&it_mutex);
-            insert_delay(); // simulate storage access delay (to i-node)
-            inode_table[inumber].i_node_type = n_type;
-
-            if (n_type == T_DIRECTORY) {
-                /* Initializes directory (filling its block with empty
-                 * entries, labeled with inumber==-1) */
-                int b = data_block_alloc();
-                if (b == -1) {
-                    /* Bloqueia o trinco da tabela de inodes. */
-                    pthread_mutex_lock(&it_mutex);
-                    /* Liberta espaço na tabela de inodes e destrói trinco read write do inode */
-                    freeinode_ts[inumber] = FREE;
-                    /* Desbloqueia o trinco da tabela de inodes. */
-                    pthread_mutex_unlock(&it_mutex);
-                    return -1;
-                }
+    insert_delay(); // simulate storage access delay (to freeinode_ts)
 
-                inode_table[inumber].i_size = BLOCK_SIZE;
-                inode_table[inumber].i_data_block = b;
+    /* Finds first free entry in i-node table and takes it for the new
+     * i-node */
+    int inumber = bitmap_claim(freeinode_ts, INODE_BITMAP_WORDS, 0, &it_mutex);
+    if (inumber == -1) {
+        return -1;
+    }
 
-                dir_entry_t *dir_entry = (dir_entry_t *)data_block_get(b);
-                if (dir_entry == NULL) {
-                    /* Liberta espaço na tabela de inodes e destrói trinco read write do inode */
-                    freeinode_ts[inumber] = FREE;
-                    return -1;
-                }
+    insert_delay(); // simulate storage access delay (to i-node)
+    inode_table[inumber].i_node_type = n_type;
+    inode_table[inumber].i_layout = L_EXTENTS;
+    inode_table[inumber].i_extent_count = 0;
+    inode_table[inumber].i_generation++;
+    /* In case of a new file, simply sets its size to 0 */
+    inode_table[inumber].i_size = 0;
+    inode_table[inumber].i_data_block = -1;
+    inode_table[inumber].i_double_block = -1;
+    inode_table[inumber].i_triple_block = -1;
+    /* Define o valor dos indexes de blocos diretos como -1 */
+    for(int i = 0; i < DIRECT_BLOCK_POINTERS; i++) {
+        inode_table[inumber].i_direct_blocks[i] = -1;
+    }
 
-                for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
-                    dir_entry[i].d_inumber = -1;
-                }
-            } else {
-                /* In case of a new file, simply sets its size to 0 */
-                inode_table[inumber].i_size = 0;
-                inode_table[inumber].i_data_block = -1;
-            }
-            /* Define o valor dos indexes de blocos diretos como -1 */
-            for(int i = 0; i < DIRECT_BLOCK_POINTERS; i++) {
-                inode_table[inumber].i_direct_blocks[i] = -1;
-            }
-            return inumber;
+    if (n_type == T_DIRECTORY) {
+        /* Initializes directory (its hash index and a first, empty bucket) */
+        if (dir_init(&inode_table[inumber]) == -1) {
+            dir_bloom_free(&inode_table[inumber]);
+            inode_data_free(inumber);
+            /* Liberta espaço na tabela de inodes */
+            bitmap_release(freeinode_ts, inumber, &it_mutex);
+            return -1;
         }
-        /* Desbloqueia o trinco da tabela de inodes. */
-        pthread_mutex_unlock(&it_mutex);
     }
-
-    return -1;
+    return inumber;
 }
 
 /*
  * Deletes the i-node.
+ * Only i-nodes that never got an entry in a directory are deleted (there is
+ * no unlink or rmdir; tfs_open() and tfs_mkdir() give back the i-node they
+ * created when they lose the race for the name), so a directory deleted
+ * here has no children, and no name of the dentry cache leads to it.
  * Input:
  *  - inumber: i-node's number
  * Returns: 0 if successful, -1 if failed
@@ -173,18 +652,18 @@ int inode_delete(int inumber) {
     insert_delay();
     insert_delay();
 
-    if (!valid_inumber(inumber) || freeinode_ts[inumber] == FREE) {
+    if (!valid_inumber(inumber) || !bitmap_taken(freeinode_ts, inumber)) {
         return -1;
     }
 
-    freeinode_ts[inumber] = FREE;
+    if (inode_table[inumber].i_node_type == T_DIRECTORY) {
+        dir_bloom_free(&inode_table[inumber]);
+    }
     if (inode_data_free(inumber) == -1) return -1;
-    
-
-    /* TODO: handle non-empty directories (either return error, or recursively
-     * delete children */
+    inode_metadata_reset(inumber);
+    /* Only then may inode_create() hand the i-node out again */
+    bitmap_release(freeinode_ts, inumber, &it_mutex);
     return 0;
-
 }
 
 /*
@@ -194,45 +673,43 @@ int inode_delete(int inumber) {
  * Returns: 0 if successful, -1 if failed
  */
 int inode_data_free(int inumber){
-    if (inode_table[inumber].i_size > 0) {
-        /* Bloqueia o trinco read write do inode em write. */
-        pthread_rwlock_wrlock(&inode_table[inumber].i_lock);
-        /* Frees all directly allocated blocks and sets each pointer to -1 */
-        for(int i = 0; i < DIRECT_BLOCK_POINTERS; i++) {
-            if (inode_table[inumber].i_direct_blocks[i] != -1){
-                if (data_block_free(inode_table[inumber].i_direct_blocks[i]) == -1) {
-                    /* Desloqueia o trinco read write do inode. */
-                    pthread_rwlock_unlock(&inode_table[inumber].i_lock);
-                    return -1;
-                }
-            }
+    inode_t *inode = &inode_table[inumber];
+
+    /* Bloqueia o trinco read write do inode em write. */
+    pthread_rwlock_wrlock(&inode->i_lock);
+    /* Block maps cached by open file entries are no longer valid */
+    inode->i_generation++;
+    if (inode->i_layout == L_EXTENTS) {
+        /* Whole extents go straight back to the free block bitmap */
+        for (int i = 0; i < inode->i_extent_count; i++) {
+            data_block_free_run(inode->i_extents[i].e_start,
+                                inode->i_extents[i].e_length);
         }
-        /* Frees all indirectly alocated blocks and frees pointer block*/
-        if (inode_table[inumber].i_data_block != -1){
-            int *content = (int *)data_block_get(inode_table[inumber].i_data_block);
-            if (content == NULL) {
-                /* Desloqueia o trinco read write do inode. */
-                pthread_rwlock_unlock(&inode_table[inumber].i_lock);
-                return -1;
-            }
-            for (int i = 0; i < MAX_BLOCK_POINTERS; i++) {
-                if (content[i] != -1){
-                    if (data_block_free(content[i]) == -1) {
-                        /* Desloqueia o trinco read write do inode. */
-                        pthread_rwlock_unlock(&inode_table[inumber].i_lock);
-                        return -1;
-                    }
-                }
-            }
-            if (data_block_free(inode_table[inumber].i_data_block) == -1) {
+        inode->i_extent_count = 0;
+        /* Desloqueia o trinco read write do inode. */
+        pthread_rwlock_unlock(&inode->i_lock);
+        return 0;
+    }
+
+    /* Frees all directly allocated blocks */
+    for(int i = 0; i < DIRECT_BLOCK_POINTERS; i++) {
+        if (inode->i_direct_blocks[i] != -1){
+            if (data_block_free(inode->i_direct_blocks[i]) == -1) {
                 /* Desloqueia o trinco read write do inode. */
-                pthread_rwlock_unlock(&inode_table[inumber].i_lock);
+                pthread_rwlock_unlock(&inode->i_lock);
                 return -1;
             }
         }
     }
+    /* Frees all indirectly alocated blocks and the pointer blocks, down
+     * every indirect tree */
+    if (pointer_trees_free(inode, true) == -1) {
+        /* Desloqueia o trinco read write do inode. */
+        pthread_rwlock_unlock(&inode->i_lock);
+        return -1;
+    }
     /* Desloqueia o trinco read write do inode. */
-    pthread_rwlock_unlock(&inode_table[inumber].i_lock);
+    pthread_rwlock_unlock(&inode->i_lock);
     return 0;
 }
 
@@ -248,6 +725,11 @@ void inode_metadata_reset(int inumber){
         inode_table[inumber].i_direct_blocks[i] = -1;
     }
     inode_table[inumber].i_data_block = -1;
+    inode_table[inumber].i_double_block = -1;
+    inode_table[inumber].i_triple_block = -1;
+    inode_table[inumber].i_layout = L_EXTENTS;
+    inode_table[inumber].i_extent_count = 0;
+    inode_table[inumber].i_generation++;
     inode_table[inumber].i_size = 0;
     /* Desloqueia o trinco read write do inode. */
     pthread_rwlock_unlock(&inode_table[inumber].i_lock);
@@ -270,170 +752,1648 @@ inode_t *inode_get(int inumber) {
 }
 
 /*
- * Updates block allocation of inode according to its offset in the open file entry.
- * Input:
- *  - file: pointer to the open file entry
- * Returns: pointer to the data referenced in the open file entry's offset, NULL if failed
+ * Path through the block pointers: the pointer block last read at each depth
+ * of an indirect tree, so that walking nearby file blocks only reads the
+ * pointer blocks that change (a sequential walk reads each one once).
  */
-char *inode_update( open_file_entry_t *file) {
-    /* Bloqueia o trinco  da open file entry. */
-    pthread_mutex_lock(&file->of_mutex);
-    /* From the open file table entry, we get the inode */
-    inode_t *inode = inode_get(file->of_inumber);
-    if (inode == NULL) {
-        /* Desloqueia o trinco da open file entry . */
-        pthread_mutex_unlock(&file->of_mutex);
-        return NULL;
-        
-    }
-    /* Bloqueia o trinco read write do inode em write. */
-    pthread_rwlock_wrlock(&inode->i_lock);
-
-    int blocks = file->of_boffset;
-    char *position;
-
-    for (int i = 0; i <= blocks && i < DIRECT_BLOCK_POINTERS; i++)
-    {
-        if (inode->i_direct_blocks[i] == -1)
-        {
-            inode->i_direct_blocks[i] = data_block_alloc();
-        }
-        
+typedef struct {
+    int pp_block[INDIRECT_LEVELS];
+    int *pp_content[INDIRECT_LEVELS];
+} pointer_path_t;
+
+static void pointer_path_init(pointer_path_t *path) {
+    for (int d = 0; d < INDIRECT_LEVELS; d++) {
+        path->pp_block[d] = EMPTY;
+        path->pp_content[d] = NULL;
     }
+}
 
-    if (blocks >= DIRECT_BLOCK_POINTERS)
-    {
-        if (inode->i_data_block == -1) {
-            inode->i_data_block = pointer_block_alloc();
-        }
-        blocks -= DIRECT_BLOCK_POINTERS;
-        int *bpointer = (int *)data_block_get(inode->i_data_block);
-        for (int i = 0; i <= blocks && i < MAX_BLOCK_POINTERS; i++)
-        {
-            if (bpointer[i] == -1)
-            {
-                bpointer[i] = data_block_alloc();
-            }
-            
+/*
+ * Returns the contents of a pointer block found at some depth of a walk,
+ * reading it only if the path holds another block at that depth.
+ */
+static int *pointer_path_read(pointer_path_t *path, int depth, int block) {
+    if (path->pp_block[depth] != block) {
+        int *content = (int *)data_block_get(block);
+        if (content == NULL) {
+            return NULL;
         }
-        /* Desloqueia o trinco read write do inode. */
-        pthread_rwlock_unlock(&inode->i_lock);
-        position = (char *)data_block_get(bpointer[blocks]);
-        position += file->of_offset;
-        /* Desloqueia o trinco da open file entry . */
-        pthread_mutex_unlock(&file->of_mutex);
-        return position;
+        path->pp_block[depth] = block;
+        path->pp_content[depth] = content;
     }
-    /* Desloqueia o trinco read write do inode. */
-    pthread_rwlock_unlock(&inode->i_lock);
-    position = (char *)data_block_get(inode->i_direct_blocks[blocks]);
-    position += file->of_offset;
-    /* Desloqueia o trinco da open file entry . */
-    pthread_mutex_unlock(&file->of_mutex);
-    return position;
+    return path->pp_content[depth];
 }
 
 /*
- * Adds an entry to the i-node directory data.
+ * Finds which indirect tree maps a file block past the direct blocks.
  * Input:
- *  - inumber: identifier of the i-node
- *  - sub_inumber: identifier of the sub i-node entry
- *  - sub_name: name of the sub i-node entry
- * Returns: SUCCESS or FAIL
+ *  - lblock: the file block (at least DIRECT_BLOCK_POINTERS)
+ *  - rest: set to the position of lblock among the blocks of that tree
+ *  - stride: set to the number of file blocks under each pointer of the
+ *    tree's root block
+ * Returns: indirect level (1 to INDIRECT_LEVELS), 0 if lblock is past
+ * MAX_FILE_BLOCKS
  */
-int add_dir_entry(int inumber, int sub_inumber, char const *sub_name) {
-    if (!valid_inumber(inumber) || !valid_inumber(sub_inumber)) {
-        return -1;
+static int pointer_level(int lblock, int *rest, int *stride) {
+    lblock -= DIRECT_BLOCK_POINTERS;
+    *stride = 1;
+    for (int level = 1; level <= INDIRECT_LEVELS; level++) {
+        int span = *stride * (int)MAX_BLOCK_POINTERS;
+        if (lblock < span) {
+            *rest = lblock;
+            return level;
+        }
+        lblock -= span;
+        *stride = span;
     }
+    return 0;
+}
 
-    insert_delay(); // simulate storage access delay to i-node with inumber
+/* Returns the i-node field holding the root of an indirect tree */
+static int *pointer_root(inode_t *inode, int level) {
+    switch (level) {
+    case 1:
+        return &inode->i_data_block;
+    case 2:
+        return &inode->i_double_block;
+    default:
+        return &inode->i_triple_block;
+    }
+}
 
+/*
+ * Returns the data block mapped to a file block by the block pointers.
+ * Input:
+ *  - inode: the i-node (with i_layout == L_POINTERS)
+ *  - lblock: the file block
+ *  - path: pointer blocks read by previous walks (see pointer_path_t)
+ *  - span: if not NULL, set to the number of file blocks from lblock on that
+ *    are known to be unmapped (a whole missing subtree counts at once), or
+ *    to 1 if lblock is mapped
+ * Returns: data block number, EMPTY if the file block is not mapped
+ */
+static int pointer_get(inode_t *inode, int lblock, pointer_path_t *path,
+                       int *span) {
+    int rest, stride;
 
-    if (inode_table[inumber].i_node_type != T_DIRECTORY) {
-        return -1;
+    if (span != NULL) {
+        *span = 1;
     }
-
-    if (strlen(sub_name) == 0) {
-        return -1;
+    if (lblock < DIRECT_BLOCK_POINTERS) {
+        return inode->i_direct_blocks[lblock];
     }
-
-    /* Locates the block containing the directory's entries */
-    dir_entry_t *dir_entry = (dir_entry_t *)data_block_get(inode_table[inumber].i_data_block); /* Isto está de acordo com a nova data struct? */
-
-    if (dir_entry == NULL) {
-        return -1;
+    int level = pointer_level(lblock, &rest, &stride);
+    if (level == 0) {
+        return EMPTY;
     }
 
-    /* Finds and fills the first empty entry */
-    for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
-        if (dir_entry[i].d_inumber == -1) {
-
-            dir_entry[i].d_inumber = sub_inumber;
-            strncpy(dir_entry[i].d_name, sub_name, MAX_FILE_NAME - 1);
-            dir_entry[i].d_name[MAX_FILE_NAME - 1] = 0;
-
-            return 0;
+    int block = *pointer_root(inode, level);
+    int covered = stride * (int)MAX_BLOCK_POINTERS;
+    for (int depth = 0;; depth++) {
+        if (block == EMPTY) {
+            if (span != NULL) {
+                *span = covered - rest % covered;
+            }
+            return EMPTY;
+        }
+        if (depth == level) {
+            return block;
         }
+        int *content = pointer_path_read(path, depth, block);
+        if (content == NULL) {
+            return EMPTY;
+        }
+        block = content[rest / stride % (int)MAX_BLOCK_POINTERS];
+        covered = stride;
+        stride /= (int)MAX_BLOCK_POINTERS;
     }
-
-    return -1;
 }
 
-/* Looks for a given name inside a directory
- * Input:
- * 	- parent directory's i-node number
- * 	- name to search
- * 	Returns i-number linked to the target name, -1 if not found
+/*
+ * Maps a file block to a data block with the block pointers, allocating the
+ * pointer blocks on its path if needed.
+ * Returns: 0 if successful, -1 otherwise
  */
-int find_in_dir(int inumber, char const *sub_name) {
-    insert_delay(); // simulate storage access delay to i-node with inumber
+static int pointer_set(inode_t *inode, int lblock, int block,
+                       pointer_path_t *path) {
+    int rest, stride;
 
-    if (!valid_inumber(inumber) ||
-        inode_table[inumber].i_node_type != T_DIRECTORY) {
-        return -1;
+    if (lblock < DIRECT_BLOCK_POINTERS) {
+        inode->i_direct_blocks[lblock] = block;
+        return 0;
     }
-
-    /* Locates the block containing the directory's entries */
-    dir_entry_t *dir_entry =
-        (dir_entry_t *)data_block_get(inode_table[inumber].i_data_block);
-    if (dir_entry == NULL) {
+    int level = pointer_level(lblock, &rest, &stride);
+    if (level == 0) {
         return -1;
     }
 
-    /* Iterates over the directory entries looking for one that has the target
-     * name */
-    for (int i = 0; i < MAX_DIR_ENTRIES; i++)
-        if ((dir_entry[i].d_inumber != -1) &&
-            (strncmp(dir_entry[i].d_name, sub_name, MAX_FILE_NAME) == 0)) {
-
-            return dir_entry[i].d_inumber;
+    int *slot = pointer_root(inode, level);
+    for (int depth = 0; depth < level; depth++) {
+        if (*slot == EMPTY) {
+            *slot = pointer_block_alloc();
+            if (*slot == EMPTY) {
+                return -1;
+            }
         }
-
-    return -1;
+        int *content = pointer_path_read(path, depth, *slot);
+        if (content == NULL) {
+            return -1;
+        }
+        slot = &content[rest / stride % (int)MAX_BLOCK_POINTERS];
+        stride /= (int)MAX_BLOCK_POINTERS;
+    }
+    *slot = block;
+    return 0;
 }
 
 /*
- * Allocated a new data block
- * Returns: block index if successful, -1 otherwise
+ * Frees a pointer block and every pointer block under it.
+ * Input:
+ *  - block: the pointer block
+ *  - depth: number of pointer blocks from it down to a data block (1 if it
+ *    points straight at data blocks)
+ *  - data: whether the data blocks it maps are freed as well
+ * Returns: 0 if successful, -1 otherwise
  */
-int data_block_alloc() {
-    for (int i = 0; i < DATA_BLOCKS; i++) {
-        if (i * (int) sizeof(allocation_state_t) % BLOCK_SIZE == 0) {
-            insert_delay(); // simulate storage access delay to free_blocks
-        }
-        /* Bloqueia trinco da tabela de data blocks. */
-        pthread_mutex_lock(&db_mutex);
-        if (free_blocks[i] == FREE) {
-            free_blocks[i] = TAKEN;
-            /* Desbloqueia trinco da tabela de data blocks. */
-            pthread_mutex_unlock(&db_mutex);
-            return i;
+static int pointer_tree_free(int block, int depth, bool data) {
+    int *content = (int *)data_block_get(block);
+    if (content == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < (int)MAX_BLOCK_POINTERS; i++) {
+        if (content[i] == EMPTY) {
+            continue;
+        }
+        if (depth > 1) {
+            if (pointer_tree_free(content[i], depth - 1, data) == -1) {
+                return -1;
+            }
+        } else if (data && data_block_free(content[i]) == -1) {
+            return -1;
+        }
+    }
+    return data_block_free(block);
+}
+
+/*
+ * Frees the pointer blocks of every indirect tree of an i-node.
+ * Input:
+ *  - inode: the i-node (write-locked by the caller)
+ *  - data: whether the data blocks they map are freed as well
+ * Returns: 0 if successful, -1 otherwise
+ */
+static int pointer_trees_free(inode_t *inode, bool data) {
+    for (int level = 1; level <= INDIRECT_LEVELS; level++) {
+        int *root = pointer_root(inode, level);
+        if (*root != EMPTY) {
+            if (pointer_tree_free(*root, level, data) == -1) {
+                return -1;
+            }
+            *root = EMPTY;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Finds the data block holding a file block.
+ * Input:
+ *  - inode: the i-node (locked by the caller)
+ *  - lblock: the file block
+ *  - run: set to the number of file blocks, starting at lblock, that are
+ *    stored in contiguous data blocks or, if lblock is not mapped, to the
+ *    length of the hole starting at lblock
+ *  - path: pointer blocks read by previous walks (see pointer_path_t)
+ * Returns: data block number, EMPTY if the file block is not mapped (a hole)
+ */
+static int inode_block_lookup(inode_t *inode, int lblock, int *run,
+                              pointer_path_t *path) {
+    if (inode->i_layout == L_EXTENTS) {
+        int next = MAX_FILE_BLOCKS;
+        for (int i = 0; i < inode->i_extent_count; i++) {
+            extent_t *e = &inode->i_extents[i];
+            if (lblock >= e->e_lblock && lblock < e->e_lblock + e->e_length) {
+                *run = e->e_lblock + e->e_length - lblock;
+                return e->e_start + lblock - e->e_lblock;
+            }
+            if (e->e_lblock > lblock) {
+                next = e->e_lblock;
+                break;
+            }
+        }
+        *run = next - lblock;
+        return EMPTY;
+    }
+
+    int block = pointer_get(inode, lblock, path, run);
+    if (block == EMPTY) {
+        int span;
+        while (lblock + *run < MAX_FILE_BLOCKS &&
+               pointer_get(inode, lblock + *run, path, &span) == EMPTY) {
+            *run += span;
+        }
+        return EMPTY;
+    }
+    /* Adjacent pointers to adjacent blocks form a run as well */
+    while (pointer_get(inode, lblock + *run, path, NULL) == block + *run) {
+        (*run)++;
+    }
+    return block;
+}
+
+/*
+ * Maps up to n file blocks, starting at lblock, to a run of contiguous data
+ * blocks: grows the extent that ends right before lblock in place if the
+ * data blocks after it are free, or adds a new extent otherwise.
+ * The n file blocks must all be unmapped.
+ * Returns: number of file blocks mapped, 0 if no extent could take them
+ */
+static int extent_alloc(inode_t *inode, int lblock, int n) {
+    int pos = 0;
+
+    while (pos < inode->i_extent_count &&
+           inode->i_extents[pos].e_lblock < lblock) {
+        pos++;
+    }
+    if (pos > 0) {
+        extent_t *prev = &inode->i_extents[pos - 1];
+        if (prev->e_lblock + prev->e_length == lblock) {
+            int got = data_block_alloc_at(prev->e_start + prev->e_length, n);
+            if (got > 0) {
+                prev->e_length += got;
+                return got;
+            }
+        }
+    }
+
+    if (inode->i_extent_count == INODE_EXTENTS) {
+        return 0;
+    }
+    int start;
+    int got = data_block_alloc_run(n, &start);
+    if (got == 0) {
+        return 0;
+    }
+    memmove(&inode->i_extents[pos + 1], &inode->i_extents[pos],
+            (size_t)(inode->i_extent_count - pos) * sizeof(extent_t));
+    inode->i_extents[pos].e_lblock = lblock;
+    inode->i_extents[pos].e_start = start;
+    inode->i_extents[pos].e_length = got;
+    inode->i_extent_count++;
+    return got;
+}
+
+/*
+ * Switches a file from extents to block pointers, keeping its blocks where
+ * they are.
+ * Returns: 0 if successful, -1 otherwise (the extents are left untouched)
+ */
+static int inode_to_pointers(inode_t *inode) {
+    pointer_path_t path;
+
+    pointer_path_init(&path);
+    inode->i_layout = L_POINTERS;
+    for (int i = 0; i < inode->i_extent_count; i++) {
+        extent_t *e = &inode->i_extents[i];
+        for (int b = 0; b < e->e_length; b++) {
+            if (pointer_set(inode, e->e_lblock + b, e->e_start + b, &path) ==
+                -1) {
+                /* Undoes the partial conversion, keeping the data blocks
+                 * (they still belong to the extents) */
+                pointer_trees_free(inode, false);
+                for (int d = 0; d < DIRECT_BLOCK_POINTERS; d++) {
+                    inode->i_direct_blocks[d] = EMPTY;
+                }
+                inode->i_layout = L_EXTENTS;
+                return -1;
+            }
+        }
+    }
+    inode->i_extent_count = 0;
+    return 0;
+}
+
+/*
+ * Makes sure the file blocks lblock .. lblock + n - 1 are mapped, allocating
+ * contiguous runs of data blocks for the missing ones.
+ * Input:
+ *  - inode: the i-node (write-locked by the caller)
+ *  - lblock: first file block
+ *  - n: number of file blocks
+ * Returns: 0 if successful, -1 if some block could not be allocated (the
+ * blocks before it stay mapped)
+ */
+static int inode_blocks_alloc(inode_t *inode, int lblock, int n) {
+    int end = lblock + n;
+    pointer_path_t path;
+
+    pointer_path_init(&path);
+    if (end > MAX_FILE_BLOCKS) {
+        return -1;
+    }
+    while (lblock < end) {
+        int run;
+        if (inode_block_lookup(inode, lblock, &run, &path) != EMPTY) {
+            lblock += run;
+            continue;
+        }
+        /* Holes cached by open file entries are about to be filled */
+        inode->i_generation++;
+        /* Only fills the hole, never overlaps the blocks after it */
+        if (run > end - lblock) {
+            run = end - lblock;
+        }
+
+        if (inode->i_layout == L_EXTENTS) {
+            int got = extent_alloc(inode, lblock, run);
+            if (got > 0) {
+                lblock += got;
+                continue;
+            }
+            /* Out of extents (or of contiguous space): falls back to block
+             * pointers for the rest of the file's life */
+            if (inode_to_pointers(inode) == -1) {
+                return -1;
+            }
+        }
+
+        int block = data_block_alloc();
+        if (block == -1) {
+            return -1;
+        }
+        if (pointer_set(inode, lblock, block, &path) == -1) {
+            data_block_free(block);
+            return -1;
+        }
+        lblock++;
+    }
+    return 0;
+}
+
+/*
+ * Refills the block map cache of an open file entry with up to OF_MAP_WINDOW
+ * runs (holes included, with e_start == EMPTY), starting at a file block.
+ * Input:
+ *  - file: the open file entry
+ *  - inode: its i-node (locked by the caller)
+ *  - lblock: first file block to cache
+ */
+static void of_map_fill(open_file_entry_t *file, inode_t *inode, int lblock) {
+    /* A single walk down the indirect blocks serves the whole window */
+    pointer_path_t path;
+
+    pointer_path_init(&path);
+
+    file->of_map_generation = inode->i_generation;
+    file->of_map_count = 0;
+    while (file->of_map_count < OF_MAP_WINDOW && lblock < MAX_FILE_BLOCKS) {
+        extent_t *run = &file->of_map[file->of_map_count++];
+        run->e_lblock = lblock;
+        run->e_start =
+            inode_block_lookup(inode, lblock, &run->e_length, &path);
+        lblock += run->e_length;
+    }
+}
+
+/*
+ * Looks up a file block in the block map cache of an open file entry.
+ * Input:
+ *  - file: the open file entry
+ *  - inode: its i-node (locked by the caller)
+ *  - lblock: the file block
+ *  - block: set to the data block number (EMPTY for a hole)
+ *  - run: set as in inode_block_lookup()
+ * Returns: true if the cache holds the file block, false otherwise
+ */
+static bool of_map_get(open_file_entry_t *file, inode_t *inode, int lblock,
+                       int *block, int *run) {
+    if (file->of_map_generation != inode->i_generation) {
+        return false;
+    }
+    for (int i = 0; i < file->of_map_count; i++) {
+        extent_t *e = &file->of_map[i];
+        if (lblock >= e->e_lblock && lblock < e->e_lblock + e->e_length) {
+            *run = e->e_lblock + e->e_length - lblock;
+            *block = e->e_start == EMPTY ? EMPTY
+                                         : e->e_start + lblock - e->e_lblock;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Allocates the missing blocks of a byte range of a file, as contiguous
+ * runs. Blocks that are only partly in the range are zeroed, so that the
+ * rest of them reads as zeros.
+ * Input:
+ *  - inode: the file's i-node (write-locked by the caller)
+ *  - position, len: the range
+ * Returns: 0 if successful, -1 if some block could not be allocated (the
+ * blocks before it stay mapped)
+ */
+static int inode_range_alloc(inode_t *inode, size_t position, size_t len) {
+    int first = (int)(position / BLOCK_SIZE);
+    size_t offset = position % BLOCK_SIZE;
+    size_t end_offset = offset + len;
+    int last = first + (int)((end_offset + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    if (last > MAX_FILE_BLOCKS) {
+        last = MAX_FILE_BLOCKS;
+    }
+    pointer_path_t path;
+    int hole;
+
+    pointer_path_init(&path);
+    bool zero_first = offset != 0 &&
+                      inode_block_lookup(inode, first, &hole, &path) == EMPTY;
+    bool zero_last = end_offset % BLOCK_SIZE != 0 &&
+                     inode_block_lookup(inode, last - 1, &hole, &path) == EMPTY;
+
+    /* Only the blocks being written are allocated: the ones before them
+     * stay holes. A failure still leaves the first blocks usable. */
+    int result = inode_blocks_alloc(inode, first, last - first);
+    if (zero_first) {
+        int b = inode_block_lookup(inode, first, &hole, &path);
+        if (b != EMPTY) {
+            memset(data_block_get(b), 0, BLOCK_SIZE);
+        }
+    }
+    if (zero_last && (last - 1 != first || !zero_first)) {
+        int b = inode_block_lookup(inode, last - 1, &hole, &path);
+        if (b != EMPTY) {
+            memset(data_block_get(b), 0, BLOCK_SIZE);
+        }
+    }
+    return result;
+}
+
+/*
+ * Maps a byte range of a file to the memory that stores it, as a list of
+ * contiguous segments, taking the locks of the open file entry and of the
+ * i-node once for all of them (rather than once per block or run).
+ * Input:
+ *  - file: pointer to the open file entry (only its block map cache is used)
+ *  - inode: the open file's i-node
+ *  - position, len: the range (the handle's offset is not used nor moved)
+ *  - alloc: whether missing blocks are allocated, all at once (for writes),
+ *    or mapped as holes (for reads)
+ *  - segments: set to the segments, in file order; holes have a NULL
+ *    s_data
+ *  - max_segments: size of segments. Only the start of the range is mapped
+ *    when it is stored in more segments.
+ * Returns: the number of segments set, 0 if the first byte of the range
+ * could not be mapped (or allocated)
+ */
+int inode_map(open_file_entry_t *file, inode_t *inode, size_t position,
+              size_t len, bool alloc, segment_t *segments, int max_segments) {
+    int count = 0;
+    bool allocated = false;
+
+    /* Bloqueia o trinco  da open file entry. */
+    pthread_mutex_lock(&file->of_mutex);
+    /* Bloqueia o trinco read write do inode em read. */
+    pthread_rwlock_rdlock(&inode->i_lock);
+    while (len > 0 && count < max_segments) {
+        int lblock = (int)(position / BLOCK_SIZE);
+        size_t offset = position % BLOCK_SIZE;
+        int block, run;
+
+        bool cached = of_map_get(file, inode, lblock, &block, &run);
+        if (!cached) {
+            of_map_fill(file, inode, lblock);
+            cached = of_map_get(file, inode, lblock, &block, &run);
+        }
+        if (alloc && (!cached || block == EMPTY)) {
+            if (allocated) {
+                /* Out of space */
+                break;
+            }
+            /* Every block still missing from the range is allocated at
+             * once, under a single write lock */
+            /* Desloqueia o trinco read write do inode. */
+            pthread_rwlock_unlock(&inode->i_lock);
+            /* Bloqueia o trinco read write do inode em write. */
+            pthread_rwlock_wrlock(&inode->i_lock);
+            inode_range_alloc(inode, position, len);
+            of_map_fill(file, inode, lblock);
+            allocated = true;
+            continue;
+        }
+        if (!cached) {
+            break;
+        }
+
+        size_t contiguous = (size_t)run * BLOCK_SIZE - offset;
+        if (contiguous > len) {
+            contiguous = len;
+        }
+        char *data = NULL;
+        if (block != EMPTY) {
+            data = (char *)data_block_get(block);
+            if (data == NULL) {
+                break;
+            }
+            data += offset;
+        }
+        segments[count].s_data = data;
+        segments[count].s_len = contiguous;
+        count++;
+        position += contiguous;
+        len -= contiguous;
+    }
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
+    /* Desloqueia o trinco da open file entry . */
+    pthread_mutex_unlock(&file->of_mutex);
+    return count;
+}
+
+/*
+ * Locks a byte range of a file, waiting while it overlaps a range held by a
+ * writer (or, for writers, any held range) or while every slot is taken.
+ * Input:
+ *  - inode: the file's i-node
+ *  - start, end: the range [start, end)
+ *  - write: whether the range is locked for writing
+ * Returns: the slot holding the range, to give to inode_range_unlock()
+ */
+int inode_range_lock(inode_t *inode, size_t start, size_t end, bool write) {
+    range_lock_t *lock = &inode->i_range_lock;
+
+    /* Bloqueia o trinco do range lock do inode. */
+    pthread_mutex_lock(&lock->rl_mutex);
+    for (;;) {
+        int free_slot = -1;
+        bool conflict = false;
+        for (int i = 0; i < RANGE_LOCK_SLOTS && !conflict; i++) {
+            range_t *range = &lock->rl_ranges[i];
+            if (!range->r_used) {
+                if (free_slot == -1) {
+                    free_slot = i;
+                }
+            } else if ((write || range->r_write) && range->r_start < end &&
+                       start < range->r_end) {
+                conflict = true;
+            }
+        }
+        if (!conflict && free_slot != -1) {
+            range_t *range = &lock->rl_ranges[free_slot];
+            range->r_start = start;
+            range->r_end = end;
+            range->r_write = write;
+            range->r_used = true;
+            /* Desbloqueia o trinco do range lock do inode. */
+            pthread_mutex_unlock(&lock->rl_mutex);
+            return free_slot;
+        }
+        pthread_cond_wait(&lock->rl_cond, &lock->rl_mutex);
+    }
+}
+
+/*
+ * Reserves a range at the end of a file for an append, and locks it for
+ * writing: the file grows over the range at once, so that appends that
+ * follow reserve the bytes after it. The write is marked started as the
+ * file grows, so the caller ends it with inode_write_end().
+ * Input:
+ *  - inode: the file's i-node
+ *  - start: set to the start of the range
+ *  - len: length of the range, cut so that the file stays within
+ *    MAX_FILE_SIZE
+ * Returns: the slot holding the range, to give to inode_range_unlock(), or
+ * -1 if the file is already MAX_FILE_SIZE long
+ */
+int inode_range_lock_append(inode_t *inode, size_t *start, size_t *len) {
+    range_lock_t *lock = &inode->i_range_lock;
+
+    /* Bloqueia o trinco do range lock do inode. */
+    pthread_mutex_lock(&lock->rl_mutex);
+    for (;;) {
+        size_t end = atomic_load(&inode->i_size);
+        if (end >= MAX_FILE_SIZE) {
+            /* Desbloqueia o trinco do range lock do inode. */
+            pthread_mutex_unlock(&lock->rl_mutex);
+            return -1;
+        }
+        size_t n = *len < MAX_FILE_SIZE - end ? *len : MAX_FILE_SIZE - end;
+
+        /* Waits for the writers (or the truncation) at the end of the file,
+         * which may still grow it */
+        int free_slot = -1;
+        bool conflict = false;
+        for (int i = 0; i < RANGE_LOCK_SLOTS && !conflict; i++) {
+            range_t *range = &lock->rl_ranges[i];
+            if (!range->r_used) {
+                if (free_slot == -1) {
+                    free_slot = i;
+                }
+            } else if (range->r_start < end + n && end < range->r_end) {
+                conflict = true;
+            }
+        }
+        if (conflict || free_slot == -1) {
+            pthread_cond_wait(&lock->rl_cond, &lock->rl_mutex);
+            continue;
+        }
+        /* Writers past the end (leaving a hole) may grow the file
+         * meanwhile: the range is only taken if the end did not move.
+         * Lock-free readers must not see the larger size before the write
+         * is marked, and are only made to retry once nothing is left to
+         * wait for */
+        inode_write_begin(inode);
+        if (!atomic_compare_exchange_strong(&inode->i_size, &end, end + n)) {
+            inode_write_end(inode);
+            continue;
+        }
+        range_t *range = &lock->rl_ranges[free_slot];
+        range->r_start = end;
+        range->r_end = end + n;
+        range->r_write = true;
+        range->r_used = true;
+        /* Desbloqueia o trinco do range lock do inode. */
+        pthread_mutex_unlock(&lock->rl_mutex);
+        *start = end;
+        *len = n;
+        return free_slot;
+    }
+}
+
+/* Grows a file to a given size, unless it is already larger */
+void inode_size_extend(inode_t *inode, size_t size) {
+    size_t old = atomic_load(&inode->i_size);
+    while (old < size &&
+           !atomic_compare_exchange_weak(&inode->i_size, &old, size)) {
+    }
+}
+
+/*
+ * Gives back the part of an append's reservation that was not written,
+ * unless an append reserved the bytes after it meanwhile (or a write went
+ * past the end), in which case the bytes stay in the file as a hole.
+ * Input:
+ *  - inode: the file's i-node (the caller still holds the range)
+ *  - reserved: the end of the reservation
+ *  - size: the end of what was written
+ */
+void inode_size_shrink(inode_t *inode, size_t reserved, size_t size) {
+    atomic_compare_exchange_strong(&inode->i_size, &reserved, size);
+}
+
+/*
+ * Unlocks a byte range locked by inode_range_lock().
+ * Input:
+ *  - inode: the file's i-node
+ *  - slot: the slot returned by inode_range_lock()
+ */
+void inode_range_unlock(inode_t *inode, int slot) {
+    range_lock_t *lock = &inode->i_range_lock;
+
+    /* Bloqueia o trinco do range lock do inode. */
+    pthread_mutex_lock(&lock->rl_mutex);
+    lock->rl_ranges[slot].r_used = false;
+    pthread_cond_broadcast(&lock->rl_cond);
+    /* Desbloqueia o trinco do range lock do inode. */
+    pthread_mutex_unlock(&lock->rl_mutex);
+}
+
+/*
+ * Marks the start of a write to a file (to its contents, block map or size),
+ * making the lock-free reads that overlap it retry. Writers still exclude
+ * each other through the range lock and i_lock.
+ */
+void inode_write_begin(inode_t *inode) {
+    atomic_fetch_add_explicit(&inode->i_seq_begin, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+/* Marks the end of a write started with inode_write_begin() */
+void inode_write_end(inode_t *inode) {
+    atomic_fetch_add_explicit(&inode->i_seq_end, 1, memory_order_release);
+}
+
+/*
+ * Reads from an open file without taking the i-node's locks: the size, the
+ * block map cache of the handle and the data are read optimistically, and
+ * the read is only kept if no write started or was in progress meanwhile
+ * (otherwise it is tried again, up to SEQ_READ_RETRIES times).
+ * Input:
+ *  - file: the open file entry (only its block map cache is used)
+ *  - inode: its i-node
+ *  - iov, iovcnt: destination buffers, filled in order
+ *  - len: their total length
+ *  - position: where to read from in the file
+ * Returns: the number of bytes read, or -1 if the read must be done under
+ * the locks: when writers keep getting in the way, or when the handle's
+ * block map cache does not cover the bytes
+ */
+ssize_t inode_read_seq(open_file_entry_t *file, inode_t *inode,
+                       struct iovec const *iov, int iovcnt, size_t len,
+                       size_t position_in_file) {
+    ssize_t result = -1;
+    iov_cursor_t cursor;
+
+    /* Bloqueia o trinco  da open file entry. */
+    pthread_mutex_lock(&file->of_mutex);
+    for (int attempt = 0; attempt < SEQ_READ_RETRIES && result == -1;
+         attempt++) {
+        unsigned int end =
+            atomic_load_explicit(&inode->i_seq_end, memory_order_acquire);
+        unsigned int begin =
+            atomic_load_explicit(&inode->i_seq_begin, memory_order_acquire);
+        if (begin != end) {
+            /* A write is in progress */
+            continue;
+        }
+
+        size_t size = inode->i_size;
+        size_t to_read = size > position_in_file ? size - position_in_file : 0;
+        if (to_read > len) {
+            to_read = len;
+        }
+        size_t done = 0;
+        bool mapped = true;
+        iov_cursor_init(&cursor, iov, iovcnt);
+        while (done < to_read && mapped) {
+            size_t offset = position_in_file + done;
+            int block, run;
+            mapped = of_map_get(file, inode, (int)(offset / BLOCK_SIZE),
+                                &block, &run);
+            if (!mapped) {
+                break;
+            }
+            size_t contiguous =
+                (size_t)run * BLOCK_SIZE - offset % BLOCK_SIZE;
+            if (contiguous > to_read - done) {
+                contiguous = to_read - done;
+            }
+            char *position =
+                block == EMPTY ? NULL : (char *)data_block_get(block);
+            /* Holes read as zeros */
+            iov_copy_to(&cursor,
+                        position == NULL ? NULL
+                                         : position + offset % BLOCK_SIZE,
+                        contiguous);
+            done += contiguous;
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&inode->i_seq_begin, memory_order_relaxed) !=
+            begin) {
+            /* A writer raced the copy */
+            continue;
+        }
+        if (!mapped) {
+            break;
+        }
+        result = (ssize_t)to_read;
+    }
+    /* Desloqueia o trinco da open file entry . */
+    pthread_mutex_unlock(&file->of_mutex);
+    return result;
+}
+
+/*
+ * Starts a cursor at the first byte of a vector of buffers
+ * Input:
+ *  - cursor: the cursor
+ *  - iov, iovcnt: the buffers
+ */
+void iov_cursor_init(iov_cursor_t *cursor, struct iovec const *iov,
+                     int iovcnt) {
+    cursor->ic_iov = iov;
+    cursor->ic_count = iovcnt;
+    cursor->ic_offset = 0;
+}
+
+/* Moves a cursor over the buffers (and the empty ones after them) that it
+ * reached the end of */
+static void iov_cursor_skip(iov_cursor_t *cursor) {
+    while (cursor->ic_count > 0 &&
+           cursor->ic_offset == cursor->ic_iov->iov_len) {
+        cursor->ic_iov++;
+        cursor->ic_count--;
+        cursor->ic_offset = 0;
+    }
+}
+
+/*
+ * Copies bytes to the buffers of a vector, from a cursor on, and moves it
+ * past them. The buffers must hold them.
+ * Input:
+ *  - cursor: where to copy to
+ *  - src: the bytes, or NULL to copy zeros
+ *  - len: how many bytes
+ */
+void iov_copy_to(iov_cursor_t *cursor, void const *src, size_t len) {
+    while (len > 0) {
+        iov_cursor_skip(cursor);
+        size_t n = cursor->ic_iov->iov_len - cursor->ic_offset;
+        if (n > len) {
+            n = len;
+        }
+        char *dst = (char *)cursor->ic_iov->iov_base + cursor->ic_offset;
+        if (src == NULL) {
+            memset(dst, 0, n);
+        } else {
+            memcpy(dst, src, n);
+            src = (char const *)src + n;
+        }
+        cursor->ic_offset += n;
+        len -= n;
+    }
+}
+
+/*
+ * Copies bytes from the buffers of a vector, from a cursor on, and moves it
+ * past them. The buffers must hold them.
+ * Input:
+ *  - cursor: where to copy from
+ *  - dst: where to copy to
+ *  - len: how many bytes
+ */
+void iov_copy_from(iov_cursor_t *cursor, void *dst, size_t len) {
+    while (len > 0) {
+        iov_cursor_skip(cursor);
+        size_t n = cursor->ic_iov->iov_len - cursor->ic_offset;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(dst, (char const *)cursor->ic_iov->iov_base + cursor->ic_offset,
+               n);
+        dst = (char *)dst + n;
+        cursor->ic_offset += n;
+        len -= n;
+    }
+}
+
+_Static_assert(sizeof(dir_bucket_t) <= BLOCK_SIZE,
+               "a directory bucket must fit in a block");
+
+/*
+ * Returns the hash of a directory entry name, over at most MAX_FILE_NAME - 1
+ * characters (the part of the name that is stored). Its low bits pick the
+ * directory bucket of the entry, and the whole value is compared before the
+ * names are.
+ */
+static uint32_t name_hash(char const *name) {
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < MAX_FILE_NAME - 1 && name[i] != '\0'; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Returns the dentry cache slot of a directory entry */
+static dentry_t *dentry_slot(int inumber, uint32_t hash) {
+    unsigned int key = hash ^ (unsigned int)inumber * 2654435761u;
+    return &dentry_cache[key % DENTRY_CACHE_SIZE];
+}
+
+/*
+ * Caches a directory entry, replacing the one in its slot.
+ */
+static void dentry_cache_add(int inumber, char const *sub_name, size_t len,
+                             uint32_t hash, int sub_inumber) {
+    dentry_t *dentry = dentry_slot(inumber, hash);
+
+    /* Bloqueia o trinco read write da dentry cache em write. */
+    pthread_rwlock_wrlock(&dc_lock);
+    dentry->dc_parent = inumber;
+    dentry->dc_inumber = sub_inumber;
+    dentry->dc_hash = hash;
+    memcpy(dentry->dc_name, sub_name, len);
+    dentry->dc_name[len] = 0;
+    /* Desloqueia o trinco read write da dentry cache. */
+    pthread_rwlock_unlock(&dc_lock);
+}
+
+/*
+ * Drops a directory entry from the dentry cache, if it is there.
+ */
+static void dentry_cache_remove(int inumber, char const *sub_name,
+                                size_t len, uint32_t hash) {
+    dentry_t *dentry = dentry_slot(inumber, hash);
+
+    /* Bloqueia o trinco read write da dentry cache em write. */
+    pthread_rwlock_wrlock(&dc_lock);
+    if (dentry->dc_inumber != EMPTY && dentry->dc_parent == inumber &&
+        dentry->dc_hash == hash && dentry->dc_name[len] == 0 &&
+        memcmp(dentry->dc_name, sub_name, len) == 0) {
+        dentry->dc_inumber = EMPTY;
+    }
+    /* Desloqueia o trinco read write da dentry cache. */
+    pthread_rwlock_unlock(&dc_lock);
+}
+
+/*
+ * Returns a block of a directory (see inode_t), allocating it if asked to.
+ * Input:
+ *  - inode: the directory's i-node (locked by the caller, write-locked to
+ *    allocate)
+ *  - lblock: the directory block
+ *  - alloc: whether a missing block is allocated
+ *  - path: pointer blocks read by previous walks (see pointer_path_t)
+ * Returns: pointer to the block's contents, NULL if it is missing or failed
+ */
+static void *dir_block_get(inode_t *inode, int lblock, bool alloc,
+                           pointer_path_t *path) {
+    int run;
+    int block = inode_block_lookup(inode, lblock, &run, path);
+
+    if (block == EMPTY && alloc) {
+        if (inode_blocks_alloc(inode, lblock, 1) == -1) {
+            return NULL;
+        }
+        block = inode_block_lookup(inode, lblock, &run, path);
+    }
+    if (block == EMPTY) {
+        return NULL;
+    }
+    return data_block_get(block);
+}
+
+/* Returns an entry of a directory's hash index */
+static int *dir_index_slot(inode_t *inode, unsigned int index, bool alloc,
+                           pointer_path_t *path) {
+    int *slots = (int *)dir_block_get(
+        inode, (int)(index / MAX_BLOCK_POINTERS), alloc, path);
+    return slots == NULL ? NULL : &slots[index % MAX_BLOCK_POINTERS];
+}
+
+/*
+ * Returns the bucket of a directory that holds the names with a given hash.
+ * Input:
+ *  - inode: the directory's i-node (locked by the caller)
+ *  - hash: the name hash
+ *  - number: if not NULL, set to the bucket's number
+ *  - path: pointer blocks read by previous walks (see pointer_path_t)
+ * Returns: pointer to the bucket, NULL if failed
+ */
+static dir_bucket_t *dir_bucket_get(inode_t *inode, uint32_t hash,
+                                    int *number, pointer_path_t *path) {
+    uint32_t mask = (1u << inode->i_dir_depth) - 1;
+    int *slot = dir_index_slot(inode, hash & mask, false, path);
+    if (slot == NULL) {
+        return NULL;
+    }
+    if (number != NULL) {
+        *number = *slot;
+    }
+    return (dir_bucket_t *)dir_block_get(inode, DIR_INDEX_BLOCKS + *slot,
+                                         false, path);
+}
+
+/* Format of the buckets of new directories */
+#ifdef TFS_DIR_FIXED
+#define DIR_FORMAT D_FIXED
+#else
+#define DIR_FORMAT D_COMPACT
+#endif
+
+/*
+ * What a directory entry holds, in either bucket format (the name is not
+ * NUL-terminated in compact buckets)
+ */
+typedef struct {
+    char const *v_name;
+    size_t v_len;
+    uint32_t v_hash;
+    int v_inumber;
+} dir_view_t;
+
+/* Empties a directory bucket */
+static void dir_bucket_init(dir_bucket_t *bucket, int depth,
+                            dir_format format) {
+    if (format == D_COMPACT) {
+        bucket->b_compact.c_count = 0;
+        bucket->b_compact.c_names = (uint16_t)DIR_BUCKET_SPACE;
+    } else {
+        for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
+            bucket->b_entries[i].d_inumber = -1;
+        }
+    }
+    bucket->b_depth = depth;
+    bucket->b_format = format;
+}
+
+/* Returns the number of entries of a bucket, cleared ones included */
+static size_t dir_bucket_size(dir_bucket_t const *bucket) {
+    return bucket->b_format == D_COMPACT ? bucket->b_compact.c_count
+                                         : MAX_DIR_ENTRIES;
+}
+
+/*
+ * Reads an entry of a directory bucket.
+ * Input:
+ *  - bucket: the bucket
+ *  - i: the entry, below dir_bucket_size()
+ *  - view: set to what the entry holds
+ * Returns: true if the entry is in use, false if it is cleared
+ */
+static bool dir_bucket_entry(dir_bucket_t const *bucket, size_t i,
+                             dir_view_t *view) {
+    if (bucket->b_format == D_COMPACT) {
+        dir_slot_t const *slot = &bucket->b_compact.c_slots[i];
+        view->v_name = &bucket->b_space[slot->s_name];
+        view->v_len = slot->s_len;
+        view->v_hash = slot->s_hash;
+        view->v_inumber = slot->s_inumber;
+    } else {
+        dir_entry_t const *entry = &bucket->b_entries[i];
+        view->v_name = entry->d_name;
+        view->v_len = strnlen(entry->d_name, MAX_FILE_NAME - 1);
+        view->v_hash = entry->d_hash;
+        view->v_inumber = entry->d_inumber;
+    }
+    return view->v_inumber != -1;
+}
+
+/*
+ * Looks for a name in a directory bucket, comparing hashes before names (in
+ * compact buckets, only the slots are read until the hashes match).
+ * Input:
+ *  - bucket: the bucket
+ *  - sub_name: the name
+ *  - len: its length
+ *  - hash: its hash
+ * Returns: the entry's index, -1 if not found
+ */
+static int dir_bucket_find(dir_bucket_t const *bucket, char const *sub_name,
+                           size_t len, uint32_t hash) {
+    size_t size = dir_bucket_size(bucket);
+    for (size_t i = 0; i < size; i++) {
+        dir_view_t view;
+        if (dir_bucket_entry(bucket, i, &view) && view.v_hash == hash &&
+            view.v_len == len && memcmp(view.v_name, sub_name, len) == 0) {
+            return (int)i;
         }
-        /* Desbloqueia trinco da tabela de data blocks. */
-        pthread_mutex_unlock(&db_mutex);
     }
     return -1;
 }
+
+/*
+ * Stores an entry in a directory bucket, reusing a cleared entry if there
+ * is one.
+ * Input:
+ *  - bucket: the bucket
+ *  - sub_name, len, hash: the entry's name, its length (below
+ *    MAX_FILE_NAME) and its hash
+ *  - sub_inumber: the entry's i-number
+ * Returns: 0 if successful, -1 if the bucket has no room for it
+ */
+static int dir_bucket_insert(dir_bucket_t *bucket, char const *sub_name,
+                             size_t len, uint32_t hash, int sub_inumber) {
+    if (bucket->b_format == D_FIXED) {
+        for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
+            dir_entry_t *entry = &bucket->b_entries[i];
+            if (entry->d_inumber == -1) {
+                entry->d_inumber = sub_inumber;
+                memcpy(entry->d_name, sub_name, len);
+                entry->d_name[len] = 0;
+                entry->d_hash = hash;
+                return 0;
+            }
+        }
+        return -1;
+    }
+
+    dir_compact_t *compact = &bucket->b_compact;
+    size_t i = 0;
+    while (i < compact->c_count && compact->c_slots[i].s_inumber != -1) {
+        i++;
+    }
+    /* The slots and the names must not meet */
+    size_t slots_end = offsetof(dir_compact_t, c_slots) +
+                       (i == compact->c_count ? i + 1 : compact->c_count) *
+                           sizeof(dir_slot_t);
+    if (slots_end + len > compact->c_names) {
+        return -1;
+    }
+    compact->c_names = (uint16_t)(compact->c_names - len);
+    memcpy(&bucket->b_space[compact->c_names], sub_name, len);
+    if (i == compact->c_count) {
+        compact->c_count++;
+    }
+    dir_slot_t *slot = &compact->c_slots[i];
+    slot->s_hash = hash;
+    slot->s_inumber = sub_inumber;
+    slot->s_name = compact->c_names;
+    slot->s_len = (uint16_t)len;
+    return 0;
+}
+
+/* Clears an entry of a directory bucket (in compact buckets, the name's
+ * space is only given back by dir_bucket_repack()) */
+static void dir_bucket_clear(dir_bucket_t *bucket, size_t i) {
+    if (bucket->b_format == D_COMPACT) {
+        bucket->b_compact.c_slots[i].s_inumber = -1;
+    } else {
+        bucket->b_entries[i].d_inumber = -1;
+    }
+}
+
+/*
+ * Rewrites a directory bucket with only its entries in use, handing those
+ * whose hash has a given bit set to a sibling bucket.
+ * Input:
+ *  - bucket: the bucket
+ *  - depth: the bucket's new depth
+ *  - sibling: the bucket that gets the entries with the bit set (emptied
+ *    first, with the same depth and format), or NULL
+ *  - bit: the bit, ignored without a sibling
+ * Returns: true if space was given back to the bucket
+ */
+static bool dir_bucket_repack(dir_bucket_t *bucket, int depth,
+                              dir_bucket_t *sibling, uint32_t bit) {
+    dir_bucket_t old = *bucket;
+    size_t size = dir_bucket_size(&old);
+    size_t kept = 0;
+
+    dir_bucket_init(bucket, depth, old.b_format);
+    if (sibling != NULL) {
+        dir_bucket_init(sibling, depth, old.b_format);
+    }
+    for (size_t i = 0; i < size; i++) {
+        dir_view_t view;
+        if (!dir_bucket_entry(&old, i, &view)) {
+            continue;
+        }
+        dir_bucket_t *to = sibling != NULL && (view.v_hash & bit) != 0
+                               ? sibling
+                               : bucket;
+        /* Always fits: the entries fitted in a single bucket before */
+        dir_bucket_insert(to, view.v_name, view.v_len, view.v_hash,
+                          view.v_inumber);
+        kept++;
+    }
+    return kept < size && old.b_format == D_COMPACT;
+}
+
+/*
+ * Splits the (full) bucket of a directory holding a hash into two buckets
+ * one bit deeper, first doubling the hash index if the bucket is as deep as
+ * the index.
+ * Input:
+ *  - inode: the directory's i-node (write-locked by the caller)
+ *  - hash: a hash held by the bucket
+ *  - path: pointer blocks read by previous walks (see pointer_path_t)
+ * Returns: 0 if successful, -1 if out of space or if the index is already
+ * DIR_INDEX_BLOCKS long
+ */
+static int dir_bucket_split(inode_t *inode, uint32_t hash,
+                            pointer_path_t *path) {
+    dir_bucket_t *bucket = dir_bucket_get(inode, hash, NULL, path);
+    if (bucket == NULL) {
+        return -1;
+    }
+
+    if (bucket->b_depth == inode->i_dir_depth) {
+        /* The second half of the doubled index repeats the first one */
+        unsigned int size = 1u << inode->i_dir_depth;
+        if (size * 2 > DIR_INDEX_BLOCKS * MAX_BLOCK_POINTERS) {
+            return -1;
+        }
+        if (size < MAX_BLOCK_POINTERS) {
+            int *slots = dir_index_slot(inode, 0, false, path);
+            if (slots == NULL) {
+                return -1;
+            }
+            memcpy(&slots[size], slots, size * sizeof(int));
+        } else {
+            int blocks = (int)(size / MAX_BLOCK_POINTERS);
+            for (int b = 0; b < blocks; b++) {
+                void *from = dir_block_get(inode, b, false, path);
+                void *to = dir_block_get(inode, blocks + b, true, path);
+                if (from == NULL || to == NULL) {
+                    return -1;
+                }
+                memcpy(to, from, BLOCK_SIZE);
+            }
+        }
+        inode->i_dir_depth++;
+    }
+
+    int number = inode->i_dir_buckets;
+    dir_bucket_t *sibling = (dir_bucket_t *)dir_block_get(
+        inode, DIR_INDEX_BLOCKS + number, true, path);
+    if (sibling == NULL) {
+        return -1;
+    }
+    inode->i_dir_buckets++;
+    inode->i_size = (size_t)(DIR_INDEX_BLOCKS + inode->i_dir_buckets) *
+                    BLOCK_SIZE;
+
+    /* The entries with the new bit set move to the sibling */
+    uint32_t bit = 1u << bucket->b_depth;
+    dir_bucket_repack(bucket, bucket->b_depth + 1, sibling, bit);
+
+    /* And so do the index entries that pointed to the bucket and have it */
+    for (uint32_t i = (hash & (bit - 1)) | bit;
+         i < (1u << inode->i_dir_depth); i += bit << 1) {
+        int *slot = dir_index_slot(inode, i, false, path);
+        if (slot == NULL) {
+            return -1;
+        }
+        *slot = number;
+    }
+    return 0;
+}
+
+/* Returns the step between the Bloom filter probes of a name hash: a second
+ * hash, odd so that the probes do not repeat */
+static uint32_t dir_bloom_step(uint32_t hash) {
+    return ((hash >> 16) | (hash << 16)) * 0x9e3779b1u | 1u;
+}
+
+/*
+ * Tells whether a name may be in a directory.
+ * Input:
+ *  - inode: the directory's i-node (locked by the caller)
+ *  - hash: the name's hash
+ * Returns: false if the name is definitely not in the directory, true if it
+ * may be
+ */
+static bool dir_bloom_test(inode_t *inode, uint32_t hash) {
+    if (inode->i_dir_bloom == NULL) {
+        return true;
+    }
+    uint32_t step = dir_bloom_step(hash);
+    for (int k = 0; k < DIR_BLOOM_HASHES; k++) {
+        size_t bit = (hash + (uint32_t)k * step) & (inode->i_dir_bloom_bits - 1);
+        if ((inode->i_dir_bloom[bit / 64] & (1ull << (bit % 64))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Sets the Bloom filter bits of a name hash */
+static void dir_bloom_set(uint64_t *bloom, size_t bits, uint32_t hash) {
+    uint32_t step = dir_bloom_step(hash);
+    for (int k = 0; k < DIR_BLOOM_HASHES; k++) {
+        size_t bit = (hash + (uint32_t)k * step) & (bits - 1);
+        bloom[bit / 64] |= 1ull << (bit % 64);
+    }
+}
+
+/* Frees the Bloom filter of a directory */
+static void dir_bloom_free(inode_t *inode) {
+    free(inode->i_dir_bloom);
+    inode->i_dir_bloom = NULL;
+    inode->i_dir_bloom_bits = 0;
+    inode->i_dir_bloom_names = 0;
+}
+
+/*
+ * Replaces the Bloom filter of a directory by an empty one.
+ * Returns: 0 if successful, -1 otherwise (the old filter is kept)
+ */
+static int dir_bloom_alloc(inode_t *inode, size_t bits) {
+    uint64_t *bloom = (uint64_t *)calloc(bits / 64, sizeof(uint64_t));
+    if (bloom == NULL) {
+        return -1;
+    }
+    free(inode->i_dir_bloom);
+    inode->i_dir_bloom = bloom;
+    inode->i_dir_bloom_bits = bits;
+    inode->i_dir_bloom_names = 0;
+    return 0;
+}
+
+/*
+ * Adds a name to the Bloom filter of a directory, doubling the filter (and
+ * refilling it from the directory's entries) once it holds more than one
+ * name per DIR_BLOOM_BITS_PER_NAME bits.
+ * Input:
+ *  - inode: the directory's i-node (write-locked by the caller)
+ *  - hash: the name's hash
+ *  - path: pointer blocks read by previous walks (see pointer_path_t)
+ */
+static void dir_bloom_add(inode_t *inode, uint32_t hash,
+                          pointer_path_t *path) {
+    if (inode->i_dir_bloom == NULL) {
+        return;
+    }
+    if ((size_t)(inode->i_dir_bloom_names + 1) * DIR_BLOOM_BITS_PER_NAME >
+        inode->i_dir_bloom_bits) {
+        uint64_t *old = inode->i_dir_bloom;
+        size_t old_bits = inode->i_dir_bloom_bits;
+        inode->i_dir_bloom = NULL;
+        if (dir_bloom_alloc(inode, old_bits * 2) == -1) {
+            /* Keeps using the (fuller) old filter */
+            inode->i_dir_bloom = old;
+            inode->i_dir_bloom_bits = old_bits;
+        } else {
+            free(old);
+            /* Cleared entries are left out of the new filter */
+            for (int b = 0; b < inode->i_dir_buckets; b++) {
+                dir_bucket_t *bucket = (dir_bucket_t *)dir_block_get(
+                    inode, DIR_INDEX_BLOCKS + b, false, path);
+                if (bucket == NULL) {
+                    /* Cannot tell the names apart any more */
+                    dir_bloom_free(inode);
+                    return;
+                }
+                size_t size = dir_bucket_size(bucket);
+                for (size_t i = 0; i < size; i++) {
+                    dir_view_t view;
+                    if (dir_bucket_entry(bucket, i, &view)) {
+                        dir_bloom_set(inode->i_dir_bloom,
+                                      inode->i_dir_bloom_bits, view.v_hash);
+                        inode->i_dir_bloom_names++;
+                    }
+                }
+            }
+        }
+    }
+    dir_bloom_set(inode->i_dir_bloom, inode->i_dir_bloom_bits, hash);
+    inode->i_dir_bloom_names++;
+}
+
+/*
+ * Sets up an empty directory: a single bucket, that the single entry of the
+ * hash index points to.
+ * Input:
+ *  - inode: the directory's new i-node
+ * Returns: 0 if successful, -1 otherwise
+ */
+static int dir_init(inode_t *inode) {
+    pointer_path_t path;
+
+    pointer_path_init(&path);
+    inode->i_dir_depth = 0;
+    inode->i_dir_buckets = 1;
+    inode->i_size = (size_t)(DIR_INDEX_BLOCKS + 1) * BLOCK_SIZE;
+
+    int *slot = dir_index_slot(inode, 0, true, &path);
+    dir_bucket_t *bucket =
+        (dir_bucket_t *)dir_block_get(inode, DIR_INDEX_BLOCKS, true, &path);
+    if (slot == NULL || bucket == NULL) {
+        return -1;
+    }
+    *slot = 0;
+    dir_bucket_init(bucket, 0, DIR_FORMAT);
+    /* Without a filter the directory still works, only without shortcuts */
+    dir_bloom_alloc(inode, DIR_BLOOM_MIN_BITS);
+    return 0;
+}
+
+/*
+ * Adds an entry to the i-node directory data.
+ * Input:
+ *  - inumber: identifier of the i-node
+ *  - sub_inumber: identifier of the sub i-node entry
+ *  - sub_name: name of the sub i-node entry
+ * Returns: SUCCESS or FAIL
+ */
+int add_dir_entry(int inumber, int sub_inumber, char const *sub_name) {
+    if (!valid_inumber(inumber) || !valid_inumber(sub_inumber)) {
+        return -1;
+    }
+
+    insert_delay(); // simulate storage access delay to i-node with inumber
+
+
+    if (inode_table[inumber].i_node_type != T_DIRECTORY) {
+        return -1;
+    }
+
+    if (strlen(sub_name) == 0) {
+        return -1;
+    }
+
+    inode_t *inode = &inode_table[inumber];
+    /* Names are cut to MAX_FILE_NAME - 1 characters */
+    size_t len = strnlen(sub_name, MAX_FILE_NAME - 1);
+    uint32_t hash = name_hash(sub_name);
+    pointer_path_t path;
+    int result = -1;
+
+    pointer_path_init(&path);
+    /* Bloqueia o trinco read write do inode em write. */
+    pthread_rwlock_wrlock(&inode->i_lock);
+    for (;;) {
+        /* Locates the bucket for the name; names are unique within a
+         * directory */
+        dir_bucket_t *bucket = dir_bucket_get(inode, hash, NULL, &path);
+        if (bucket == NULL ||
+            dir_bucket_find(bucket, sub_name, len, hash) != -1) {
+            break;
+        }
+
+        if (dir_bucket_insert(bucket, sub_name, len, hash, sub_inumber) ==
+            0) {
+            dir_bloom_add(inode, hash, &path);
+            dentry_cache_add(inumber, sub_name, len, hash, sub_inumber);
+            result = 0;
+            break;
+        }
+
+        /* The bucket is full: gives it back the space of its cleared
+         * names or, if there is none, splits it, and tries again */
+        if (!dir_bucket_repack(bucket, bucket->b_depth, NULL, 0) &&
+            dir_bucket_split(inode, hash, &path) == -1) {
+            break;
+        }
+    }
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
+    return result;
+}
+
+/*
+ * Removes the entry of a sub i-node from the i-node directory data (the
+ * entry is found by i-number, so every bucket may be read).
+ * Input:
+ *  - inumber: identifier of the i-node
+ *  - sub_inumber: identifier of the sub i-node entry
+ * Returns: SUCCESS or FAIL
+ */
+int clear_dir_entry(int inumber, int sub_inumber) {
+    if (!valid_inumber(inumber) || !valid_inumber(sub_inumber)) {
+        return -1;
+    }
+
+    insert_delay(); // simulate storage access delay to i-node with inumber
+
+    if (inode_table[inumber].i_node_type != T_DIRECTORY) {
+        return -1;
+    }
+
+    inode_t *inode = &inode_table[inumber];
+    pointer_path_t path;
+    int result = -1;
+
+    pointer_path_init(&path);
+    /* Bloqueia o trinco read write do inode em write. */
+    pthread_rwlock_wrlock(&inode->i_lock);
+    for (int b = 0; b < inode->i_dir_buckets && result == -1; b++) {
+        dir_bucket_t *bucket = (dir_bucket_t *)dir_block_get(
+            inode, DIR_INDEX_BLOCKS + b, false, &path);
+        if (bucket == NULL) {
+            break;
+        }
+        size_t size = dir_bucket_size(bucket);
+        for (size_t i = 0; i < size; i++) {
+            dir_view_t view;
+            if (dir_bucket_entry(bucket, i, &view) &&
+                view.v_inumber == sub_inumber) {
+                dir_bucket_clear(bucket, i);
+                dentry_cache_remove(inumber, view.v_name, view.v_len,
+                                    view.v_hash);
+                result = 0;
+                break;
+            }
+        }
+    }
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
+    return result;
+}
+
+/*
+ * Looks for a name inside a directory (see find_in_dir()), caching the
+ * entry found if asked to: it is cached while the directory is locked, so
+ * that it cannot be cleared in between.
+ */
+static int dir_search(int inumber, char const *sub_name, bool cache) {
+    if (!valid_inumber(inumber)) {
+        return -1;
+    }
+
+    /* Names of MAX_FILE_NAME characters or more are never stored */
+    size_t len = strnlen(sub_name, MAX_FILE_NAME);
+    if (len == MAX_FILE_NAME) {
+        return -1;
+    }
+
+    inode_t *inode = &inode_table[inumber];
+    uint32_t hash = name_hash(sub_name);
+    pointer_path_t path;
+    int sub_inumber = -1;
+
+    pointer_path_init(&path);
+    /* Bloqueia o trinco read write do inode em read. */
+    pthread_rwlock_rdlock(&inode->i_lock);
+    /* Names the Bloom filter has not seen are answered without reading the
+     * directory */
+    if (inode->i_node_type != T_DIRECTORY || !dir_bloom_test(inode, hash)) {
+        /* Desloqueia o trinco read write do inode. */
+        pthread_rwlock_unlock(&inode->i_lock);
+        return -1;
+    }
+
+    insert_delay(); // simulate storage access delay to i-node with inumber
+
+    /* Only reads the index entry and the bucket for the name's hash */
+    dir_bucket_t *bucket = dir_bucket_get(inode, hash, NULL, &path);
+    int i = bucket == NULL ? -1 : dir_bucket_find(bucket, sub_name, len, hash);
+    if (i != -1) {
+        dir_view_t view;
+        dir_bucket_entry(bucket, (size_t)i, &view);
+        sub_inumber = view.v_inumber;
+        if (cache) {
+            dentry_cache_add(inumber, sub_name, len, hash, sub_inumber);
+        }
+    }
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
+
+    return sub_inumber;
+}
+
+/* Looks for a given name inside a directory
+ * Input:
+ * 	- parent directory's i-node number
+ * 	- name to search
+ * 	Returns i-number linked to the target name, -1 if not found
+ */
+int find_in_dir(int inumber, char const *sub_name) {
+    return dir_search(inumber, sub_name, false);
+}
+
+/* Looks for a given name inside a directory, through the dentry cache (so
+ * that names found before skip find_in_dir() and its storage accesses)
+ * Input:
+ * 	- parent directory's i-node number
+ * 	- name to search
+ * 	Returns i-number linked to the target name, -1 if not found
+ */
+int dentry_lookup(int inumber, char const *sub_name) {
+    uint32_t hash = name_hash(sub_name);
+    dentry_t *dentry = dentry_slot(inumber, hash);
+    int sub_inumber = EMPTY;
+
+    /* Bloqueia o trinco read write da dentry cache em read. */
+    pthread_rwlock_rdlock(&dc_lock);
+    if (dentry->dc_inumber != EMPTY && dentry->dc_parent == inumber &&
+        dentry->dc_hash == hash &&
+        strncmp(dentry->dc_name, sub_name, MAX_FILE_NAME) == 0) {
+        sub_inumber = dentry->dc_inumber;
+    }
+    /* Desloqueia o trinco read write da dentry cache. */
+    pthread_rwlock_unlock(&dc_lock);
+    if (sub_inumber != EMPTY) {
+        return sub_inumber;
+    }
+
+    return dir_search(inumber, sub_name, true);
+}
+
+/*
+ * Allocated a new data block
+ * Returns: block index if successful, -1 otherwise
+ */
+int data_block_alloc() {
+    magazine_t *mag = magazine_get();
+
+    if (mag == NULL || mag->m_count == 0) {
+        int batch[MAGAZINE_BATCH];
+
+        /* The whole bitmap fits in a single block */
+        insert_delay(); // simulate storage access delay to free_blocks
+
+        int n = bitmap_claim_batch(free_blocks, BITMAP_WORDS,
+                                   block_alloc_start(), &db_mutex, batch,
+                                   mag == NULL ? 1 : MAGAZINE_BATCH);
+        if (n == 0) {
+            return -1;
+        }
+#ifndef TFS_ALLOC_MUTEX
+        alloc_hint = (size_t)batch[n - 1] / BITMAP_WORD_BITS;
+#endif
+        if (mag == NULL) {
+            return batch[0];
+        }
+        /* Stacked in reverse, so that blocks are handed out in ascending
+         * order */
+        for (int i = 0; i < n; i++) {
+            mag->m_blocks[i] = batch[n - 1 - i];
+        }
+        mag->m_count = n;
+    }
+    return mag->m_blocks[--mag->m_count];
+}
+
+/*
+ * Counts the data blocks that are currently free
+ * Returns: number of free blocks
+ */
+int data_block_free_count() {
+    int taken = 0;
+
+    /* Without TFS_ALLOC_MUTEX this is a snapshot that may already be stale
+     * if other threads are allocating. Blocks reserved in magazines are
+     * counted as taken. */
+    for (size_t w = 0; w < BITMAP_WORDS; w++) {
+        taken += __builtin_popcountll(
+            atomic_load_explicit(&free_blocks[w], memory_order_relaxed));
+    }
+    /* Padding bits of the last word are always set */
+    return BITMAP_WORDS * BITMAP_WORD_BITS - taken;
+}
 /*
  * Allocats a new pointer block (with all values set to 0)
  * Returns: block index if successful, -1 otherwise
@@ -464,12 +2424,23 @@ int data_block_free(int block_number) {
         return -1;
     }
 
-    insert_delay(); // simulate storage access delay to free_blocks
-    /* Bloqueia o trinco da tabela de data blocks. */
-    pthread_mutex_lock(&db_mutex);
-    free_blocks[block_number] = FREE;
-    /* Desbloqueia o trinco da tabela de data blocks. */
-    pthread_mutex_unlock(&db_mutex);
+    magazine_t *mag = magazine_get();
+    if (mag == NULL) {
+        insert_delay(); // simulate storage access delay to free_blocks
+        bitmap_release(free_blocks, block_number, &db_mutex);
+        return 0;
+    }
+
+    if (mag->m_count == MAGAZINE_SIZE) {
+        /* Drains the oldest blocks of a full magazine */
+        insert_delay(); // simulate storage access delay to free_blocks
+        bitmap_release_batch(free_blocks, mag->m_blocks, MAGAZINE_BATCH,
+                             &db_mutex);
+        memmove(mag->m_blocks, mag->m_blocks + MAGAZINE_BATCH,
+                (MAGAZINE_SIZE - MAGAZINE_BATCH) * sizeof(int));
+        mag->m_count -= MAGAZINE_BATCH;
+    }
+    mag->m_blocks[mag->m_count++] = block_number;
     return 0;
 }
 
@@ -491,9 +2462,10 @@ void *data_block_get(int block_number) {
  * Inputs:
  * 	- I-node number of the file to open
  * 	- Initial offset
+ * 	- Whether writes append to the file (see tfs_write())
  * Returns: file handle if successful, -1 otherwise
  */
-int add_to_open_file_table(int inumber, size_t offset) {
+int add_to_open_file_table(int inumber, size_t offset, bool append) {
     for (int i = 0; i < MAX_OPEN_FILES; i++) {
         /* Bloqueia o trinco do FS volatile state */
         pthread_mutex_lock(&vs_mutex);
@@ -513,6 +2485,8 @@ int add_to_open_file_table(int inumber, size_t offset) {
             offset = offset % BLOCK_SIZE;
 
             open_file_table[i].of_offset = offset;
+            open_file_table[i].of_append = append;
+            open_file_table[i].of_map_count = 0;
 
             if (pthread_mutex_init(&open_file_table[i].of_mutex, NULL) == -1) return -1;
             return i;
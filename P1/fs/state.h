@@ -3,9 +3,13 @@
 
 #include "config.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <pthread.h>
 
 /*
@@ -14,19 +18,119 @@
 typedef struct {
     char d_name[MAX_FILE_NAME];
     int d_inumber;
+    uint32_t d_hash; /* hash of d_name (see name_hash()) */
 } dir_entry_t;
 
+/*
+ * Compact directory entry: the name is kept, without its terminator, in the
+ * string table of the bucket
+ */
+typedef struct {
+    uint32_t s_hash;  /* hash of the name (see name_hash()) */
+    int s_inumber;
+    uint16_t s_name;  /* offset of the name in the bucket */
+    uint16_t s_len;   /* length of the name */
+} dir_slot_t;
+
+/* How the entries of a directory bucket are stored: as fixed dir_entry_t
+ * entries, or as dir_slot_t slots growing from the start of the bucket and
+ * names packed from its end */
+typedef enum { D_FIXED, D_COMPACT } dir_format;
+
+/* Space for entries in each directory bucket (a block, less the bucket's
+ * depth and format) */
+#define DIR_BUCKET_SPACE (BLOCK_SIZE - 2 * sizeof(int))
+#define MAX_DIR_ENTRIES (DIR_BUCKET_SPACE / sizeof(dir_entry_t))
+#define MAX_DIR_SLOTS                                                          \
+    ((DIR_BUCKET_SPACE - 2 * sizeof(uint16_t)) / sizeof(dir_slot_t))
+
+typedef struct {
+    uint16_t c_count; /* slots used, cleared ones included */
+    uint16_t c_names; /* offset of the first (lowest) name */
+    dir_slot_t c_slots[MAX_DIR_SLOTS];
+} dir_compact_t;
+
+/*
+ * Directory bucket: a directory block with the entries whose name hashes end
+ * in the same b_depth bits
+ */
+typedef struct {
+    union {
+        dir_entry_t b_entries[MAX_DIR_ENTRIES]; /* D_FIXED */
+        dir_compact_t b_compact;                /* D_COMPACT */
+        char b_space[DIR_BUCKET_SPACE];
+    };
+    int b_depth;
+    dir_format b_format;
+} dir_bucket_t;
+
 typedef enum { T_FILE, T_DIRECTORY } inode_type;
 
+/*
+ * Extent: a run of contiguous data blocks holding contiguous file blocks
+ */
+typedef struct {
+    int e_lblock; /* first file block covered by the extent */
+    int e_start;  /* data block holding file block e_lblock */
+    int e_length; /* number of blocks in the run */
+} extent_t;
+
+/* How the blocks of a file are mapped: by up to INODE_EXTENTS extents, or
+ * (once a fragmented disk needs more extents than that) by block pointers */
+typedef enum { L_EXTENTS, L_POINTERS } inode_layout;
+
+/*
+ * Byte range lock: the ranges [r_start, r_end) of a file held by readers
+ * and writers. Ranges held by writers overlap no other range.
+ */
+typedef struct {
+    size_t r_start;
+    size_t r_end;
+    bool r_write;
+    bool r_used;
+} range_t;
+
+typedef struct {
+    pthread_mutex_t rl_mutex;
+    pthread_cond_t rl_cond; /* signalled whenever a range is released */
+    range_t rl_ranges[RANGE_LOCK_SLOTS];
+} range_lock_t;
+
 /*
  * I-node
  */
 typedef struct {
     inode_type i_node_type;
-    size_t i_size;
+    _Atomic size_t i_size; /* grown without i_lock by appends */
+    inode_layout i_layout;
+    int i_extent_count;
+    extent_t i_extents[INODE_EXTENTS]; /* sorted by e_lblock */
+    unsigned int i_generation; /* bumped whenever the block map changes */
     int i_data_block; //referencia para uma tabela de referencias indiretas & i-node refere um bloco de indices
     int i_direct_blocks[DIRECT_BLOCK_POINTERS]; //vetor de indices para blocos com referencia direta
+    int i_double_block; /* pointer block of pointer blocks */
+    int i_triple_block; /* pointer block of double indirect blocks */
+    /* Directories (extendible hashing): file blocks [0, DIR_INDEX_BLOCKS)
+     * hold an index of 2^i_dir_depth bucket numbers, picked by the low bits
+     * of a name's hash; bucket k is file block DIR_INDEX_BLOCKS + k */
+    int i_dir_depth;
+    int i_dir_buckets;
+    /* Directories: Bloom filter (in memory only) over the hashes of the
+     * names added, i_dir_bloom_bits long; NULL if it could not be
+     * allocated, in which case every name may be in the directory */
+    uint64_t *i_dir_bloom;
+    size_t i_dir_bloom_bits;
+    int i_dir_bloom_names;
     pthread_rwlock_t i_lock; /* read write lock para inodes */
+    /* File contents: reads and writes lock the bytes they copy, so that
+     * only overlapping accesses wait for each other (i_lock still guards
+     * the block map and i_size) */
+    range_lock_t i_range_lock;
+    /* Sequence counters of the writers of the file (contents, block map or
+     * size): bumped by each writer as it starts and as it ends, so that
+     * they differ while a write is in progress (see inode_read_seq()) */
+    _Atomic unsigned int i_seq_begin;
+    _Atomic unsigned int i_seq_end;
     /* in a real FS, more fields would exist here */
 } inode_t;
 
@@ -38,11 +142,34 @@ typedef enum { FREE = 0, TAKEN = 1 } allocation_state_t;
 typedef struct {
     int of_inumber;
     size_t of_offset;
+    bool of_append; /* writes go to the end of the file (TFS_O_APPEND) */
     int of_boffset;
     pthread_mutex_t of_mutex;
+    /* Block map cache: the runs resolved by the last lookup (and the ones
+     * after them), covering consecutive file blocks; holes are cached as
+     * runs with e_start == EMPTY. Only valid while the i-node's
+     * i_generation is of_map_generation. */
+    int of_map_count;
+    unsigned int of_map_generation;
+    extent_t of_map[OF_MAP_WINDOW];
 } open_file_entry_t;
 
-#define MAX_DIR_ENTRIES (BLOCK_SIZE / sizeof(dir_entry_t))
+/*
+ * Position in a vector of buffers (see tfs_readv() and tfs_writev())
+ */
+typedef struct {
+    struct iovec const *ic_iov; /* the buffer being copied */
+    int ic_count;               /* buffers left, that one included */
+    size_t ic_offset;           /* bytes of that buffer already copied */
+} iov_cursor_t;
+
+/*
+ * Bytes of a file stored contiguously in memory (see inode_map())
+ */
+typedef struct {
+    char *s_data; /* NULL for a hole */
+    size_t s_len;
+} segment_t;
 
 void state_init();
 void state_destroy();
@@ -52,18 +179,36 @@ int inode_delete(int inumber);
 int inode_data_free(int inumber);
 void inode_metadata_reset(int inumber);
 inode_t *inode_get(int inumber);
-char *inode_update(open_file_entry_t *file);
+int inode_map(open_file_entry_t *file, inode_t *inode, size_t position,
+              size_t len, bool alloc, segment_t *segments, int max_segments);
+int inode_range_lock(inode_t *inode, size_t start, size_t end, bool write);
+void inode_range_unlock(inode_t *inode, int slot);
+int inode_range_lock_append(inode_t *inode, size_t *start, size_t *len);
+void inode_size_extend(inode_t *inode, size_t size);
+void inode_size_shrink(inode_t *inode, size_t reserved, size_t size);
+void inode_write_begin(inode_t *inode);
+void inode_write_end(inode_t *inode);
+ssize_t inode_read_seq(open_file_entry_t *file, inode_t *inode,
+                       struct iovec const *iov, int iovcnt, size_t len,
+                       size_t position);
+
+void iov_cursor_init(iov_cursor_t *cursor, struct iovec const *iov,
+                     int iovcnt);
+void iov_copy_to(iov_cursor_t *cursor, void const *src, size_t len);
+void iov_copy_from(iov_cursor_t *cursor, void *dst, size_t len);
 
 int clear_dir_entry(int inumber, int sub_inumber);
 int add_dir_entry(int inumber, int sub_inumber, char const *sub_name);
 int find_in_dir(int inumber, char const *sub_name);
+int dentry_lookup(int inumber, char const *sub_name);
 
 int pointer_block_alloc();
 int data_block_alloc();
+int data_block_free_count();
 int data_block_free(int block_number);
 void *data_block_get(int block_number);
 
-int add_to_open_file_table(int inumber, size_t offset);
+int add_to_open_file_table(int inumber, size_t offset, bool append);
 int remove_from_open_file_table(int fhandle);
 open_file_entry_t *get_open_file_entry(int fhandle);
 
@@ -0,0 +1,90 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+
+/*  Several threads write fixed-size slots of one shared file (slots that
+    straddle block boundaries), each through its own handle, while other
+    threads read whole slots back: a slot is never seen half written, and
+    at the end every slot holds its writer's last round. */
+
+#define WRITERS (6)
+#define READERS (3)
+#define SLOTS_PER_WRITER (8)
+#define SLOT (700)
+#define ROUNDS (40)
+
+static char const *path = "/shared";
+
+static void *writer(void *arg) {
+    int id = *(int *)arg;
+    char slot[SLOT];
+    int f = tfs_open(path, 0);
+    assert(f != -1);
+
+    for (int r = 1; r <= ROUNDS; r++) {
+        memset(slot, id * ROUNDS + r, SLOT);
+        for (int s = 0; s < SLOTS_PER_WRITER; s++) {
+            off_t offset = (off_t)(s * WRITERS + id) * SLOT;
+            assert(tfs_lseek(f, offset, TFS_SEEK_SET) == offset);
+            assert(tfs_write(f, slot, SLOT) == SLOT);
+        }
+    }
+    assert(tfs_close(f) != -1);
+    return NULL;
+}
+
+static void *reader(void *arg) {
+    int id = *(int *)arg;
+    char slot[SLOT];
+    int f = tfs_open(path, 0);
+    assert(f != -1);
+
+    for (int r = 0; r < ROUNDS * 4; r++) {
+        off_t offset = (off_t)((r + id) % (WRITERS * SLOTS_PER_WRITER)) * SLOT;
+        assert(tfs_lseek(f, offset, TFS_SEEK_SET) == offset);
+        ssize_t n = tfs_read(f, slot, SLOT);
+        assert(n >= 0);
+        /* Either all of one round, or (past the end so far) nothing */
+        for (ssize_t i = 1; i < n; i++) {
+            assert(slot[i] == slot[0]);
+        }
+    }
+    assert(tfs_close(f) != -1);
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[WRITERS + READERS];
+    int ids[WRITERS + READERS];
+
+    assert(tfs_init() != -1);
+    int f = tfs_open(path, TFS_O_CREAT);
+    assert(f != -1);
+
+    for (int i = 0; i < WRITERS + READERS; i++) {
+        ids[i] = i < WRITERS ? i : i - WRITERS;
+        assert(pthread_create(&threads[i], NULL,
+                              i < WRITERS ? writer : reader, &ids[i]) == 0);
+    }
+    for (int i = 0; i < WRITERS + READERS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    char slot[SLOT];
+    assert(tfs_read(f, slot, 0) == 0);
+    for (int s = 0; s < WRITERS * SLOTS_PER_WRITER; s++) {
+        assert(tfs_read(f, slot, SLOT) == SLOT);
+        for (int i = 0; i < SLOT; i++) {
+            assert(slot[i] == (char)(s % WRITERS * ROUNDS + ROUNDS));
+        }
+    }
+    assert(tfs_read(f, slot, SLOT) == 0);
+    assert(tfs_close(f) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+
+/*  Readers read a whole file over and over (through the lock-free path,
+    once their handles have the block map cached) while a writer rewrites
+    it, each round with a single byte value, and truncates it now and then:
+    a read never mixes two rounds. */
+
+#define READERS (4)
+#define FILE_BYTES (5 * BLOCK_SIZE + 100)
+#define ROUNDS (200)
+#define READS (2000)
+
+static char const *path = "/f";
+
+static void *reader(void *arg) {
+    (void)arg;
+    static _Thread_local char buffer[FILE_BYTES];
+    int f = tfs_open(path, 0);
+    assert(f != -1);
+
+    for (int r = 0; r < READS; r++) {
+        assert(tfs_lseek(f, 0, TFS_SEEK_SET) == 0);
+        ssize_t n = tfs_read(f, buffer, FILE_BYTES);
+        assert(n >= 0);
+        for (ssize_t i = 1; i < n; i++) {
+            assert(buffer[i] == buffer[0]);
+        }
+    }
+    assert(tfs_close(f) != -1);
+    return NULL;
+}
+
+int main() {
+    static char data[FILE_BYTES];
+    pthread_t threads[READERS];
+
+    assert(tfs_init() != -1);
+    int f = tfs_open(path, TFS_O_CREAT);
+    assert(f != -1);
+    memset(data, 1, FILE_BYTES);
+    assert(tfs_write(f, data, FILE_BYTES) == FILE_BYTES);
+
+    for (int i = 0; i < READERS; i++) {
+        assert(pthread_create(&threads[i], NULL, reader, NULL) == 0);
+    }
+    for (int r = 2; r < ROUNDS; r++) {
+        if (r % 50 == 0) {
+            assert(tfs_close(f) != -1);
+            f = tfs_open(path, TFS_O_TRUNC);
+            assert(f != -1);
+        }
+        memset(data, r, FILE_BYTES);
+        assert(tfs_lseek(f, 0, TFS_SEEK_SET) == 0);
+        assert(tfs_write(f, data, FILE_BYTES) == FILE_BYTES);
+    }
+    for (int i = 0; i < READERS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    /* Without writers, reads see the last round */
+    char buffer[FILE_BYTES];
+    assert(tfs_lseek(f, 0, TFS_SEEK_SET) == 0);
+    assert(tfs_read(f, buffer, FILE_BYTES) == FILE_BYTES);
+    assert(tfs_lseek(f, 0, TFS_SEEK_SET) == 0);
+    assert(tfs_read(f, buffer, FILE_BYTES) == FILE_BYTES);
+    assert(memcmp(buffer, data, FILE_BYTES) == 0);
+    assert(tfs_close(f) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
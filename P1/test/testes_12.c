@@ -0,0 +1,81 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+
+/*  Several threads append fixed-size records to one log file, each through
+    its own TFS_O_APPEND handle: no record is lost or overwritten, and each
+    record is written whole. */
+
+#define THREADS (8)
+#define RECORDS (300)
+#define RECORD (50)
+
+static char const *path = "/log";
+
+static void *appender(void *arg) {
+    int id = *(int *)arg;
+    char record[RECORD];
+    int f = tfs_open(path, TFS_O_APPEND);
+    assert(f != -1);
+
+    memset(record, 'a' + id, RECORD);
+    for (int r = 0; r < RECORDS; r++) {
+        assert(tfs_write(f, record, RECORD) == RECORD);
+    }
+    assert(tfs_close(f) != -1);
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[THREADS];
+    int ids[THREADS];
+    int counts[THREADS] = {0};
+    char record[RECORD];
+
+    assert(tfs_init() != -1);
+    int f = tfs_open(path, TFS_O_CREAT);
+    assert(f != -1);
+
+    for (int i = 0; i < THREADS; i++) {
+        ids[i] = i;
+        assert(pthread_create(&threads[i], NULL, appender, &ids[i]) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    for (int r = 0; r < THREADS * RECORDS; r++) {
+        assert(tfs_read(f, record, RECORD) == RECORD);
+        int id = record[0] - 'a';
+        assert(id >= 0 && id < THREADS);
+        for (int i = 1; i < RECORD; i++) {
+            assert(record[i] == record[0]);
+        }
+        counts[id]++;
+    }
+    assert(tfs_read(f, record, RECORD) == 0);
+    for (int i = 0; i < THREADS; i++) {
+        assert(counts[i] == RECORDS);
+    }
+    assert(tfs_close(f) != -1);
+
+    /* An append handle appends after writes made through other handles */
+    f = tfs_open(path, TFS_O_APPEND);
+    int g = tfs_open(path, 0);
+    assert(f != -1 && g != -1);
+    assert(tfs_lseek(g, 0, TFS_SEEK_END) == THREADS * RECORDS * RECORD);
+    assert(tfs_write(g, "xy", 2) == 2);
+    assert(tfs_write(f, "z", 1) == 1);
+    assert(tfs_lseek(g, -3, TFS_SEEK_END) == THREADS * RECORDS * RECORD);
+    assert(tfs_read(g, record, RECORD) == 3);
+    assert(memcmp(record, "xyz", 3) == 0);
+    assert(tfs_close(f) != -1);
+    assert(tfs_close(g) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+
+/*  Threads share a single handle and write and read records at their own
+    offsets with tfs_pwrite/tfs_pread, which leave the handle's offset
+    alone. */
+
+#define THREADS (6)
+#define RECORDS (60)
+#define RECORD (300)
+
+static int f;
+
+static void *worker(void *arg) {
+    int id = *(int *)arg;
+    char record[RECORD], back[RECORD];
+
+    for (int r = 0; r < RECORDS; r++) {
+        off_t offset = (off_t)(r * THREADS + id) * RECORD;
+        memset(record, 'A' + (id + r) % 26, RECORD);
+        assert(tfs_pwrite(f, record, RECORD, offset) == RECORD);
+        assert(tfs_pread(f, back, RECORD, offset) == RECORD);
+        assert(memcmp(back, record, RECORD) == 0);
+    }
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[THREADS];
+    int ids[THREADS];
+    char buffer[RECORD];
+
+    assert(tfs_init() != -1);
+    f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+
+    for (int i = 0; i < THREADS; i++) {
+        ids[i] = i;
+        assert(pthread_create(&threads[i], NULL, worker, &ids[i]) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    /* The handle's offset did not move */
+    assert(tfs_lseek(f, 0, TFS_SEEK_CUR) == 0);
+    for (int i = 0; i < THREADS * RECORDS; i++) {
+        assert(tfs_read(f, buffer, RECORD) == RECORD);
+        assert(buffer[0] == 'A' + (i % THREADS + i / THREADS) % 26);
+        assert(buffer[RECORD - 1] == buffer[0]);
+    }
+
+    /* Past the end, and bad offsets */
+    off_t end = (off_t)THREADS * RECORDS * RECORD;
+    assert(tfs_pread(f, buffer, RECORD, end) == 0);
+    assert(tfs_pread(f, buffer, RECORD, end - 10) == 10);
+    assert(tfs_pread(f, buffer, RECORD, -1) == -1);
+    assert(tfs_pwrite(f, buffer, RECORD, -1) == -1);
+    assert(tfs_pwrite(f, "x", 1, MAX_FILE_SIZE) == 0);
+
+    /* Writing past the end leaves a hole */
+    assert(tfs_pwrite(f, "end", 3, end + 2000) == 3);
+    assert(tfs_pread(f, buffer, RECORD, end) == RECORD);
+    for (int i = 0; i < RECORD; i++) {
+        assert(buffer[i] == 0);
+    }
+    assert(tfs_pread(f, buffer, 10, end + 2000) == 3);
+    assert(memcmp(buffer, "end", 3) == 0);
+    assert(tfs_lseek(f, 0, TFS_SEEK_CUR) == end);
+
+    assert(tfs_close(f) != -1);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
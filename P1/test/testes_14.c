@@ -0,0 +1,86 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <limits.h>
+#include <string.h>
+
+/*  Writes records scattered over several buffers (empty ones and ones that
+    cross block boundaries included) with tfs_writev, through a plain and
+    an append handle, and reads them back, gathered and scattered, with
+    tfs_readv and tfs_read. */
+
+#define RECORDS (40)
+#define HEADER (12)
+#define BODY (1500)
+
+int main() {
+    char header[HEADER], body[BODY], trailer[] = "end";
+    char r_header[HEADER], r_body[BODY], r_trailer[sizeof(trailer)];
+    size_t record = HEADER + BODY + sizeof(trailer);
+
+    assert(tfs_init() != -1);
+    int f = tfs_open("/f", TFS_O_CREAT);
+    int a = tfs_open("/f", TFS_O_APPEND);
+    assert(f != -1 && a != -1);
+
+    for (int r = 0; r < RECORDS; r++) {
+        sprintf(header, "record %04d", r);
+        memset(body, 'a' + r % 26, BODY);
+        struct iovec iov[] = {{header, HEADER},
+                              {NULL, 0},
+                              {body, BODY},
+                              {trailer, sizeof(trailer)}};
+        /* Even records through the plain handle, odd ones appended */
+        if (r % 2 == 0) {
+            assert(tfs_lseek(f, 0, TFS_SEEK_END) == (off_t)((size_t)r * record));
+            assert(tfs_writev(f, iov, 4) == (ssize_t)record);
+            assert(tfs_lseek(f, 0, TFS_SEEK_CUR) ==
+                   (off_t)((size_t)(r + 1) * record));
+        } else {
+            assert(tfs_writev(a, iov, 4) == (ssize_t)record);
+        }
+    }
+
+    /* Scattered back into the same layout */
+    assert(tfs_lseek(f, 0, TFS_SEEK_SET) == 0);
+    for (int r = 0; r < RECORDS; r++) {
+        struct iovec iov[] = {{r_header, HEADER},
+                              {r_body, BODY},
+                              {NULL, 0},
+                              {r_trailer, sizeof(r_trailer)}};
+        assert(tfs_readv(f, iov, 4) == (ssize_t)record);
+        sprintf(header, "record %04d", r);
+        assert(memcmp(r_header, header, HEADER) == 0);
+        assert(r_body[0] == 'a' + r % 26 && r_body[BODY - 1] == r_body[0]);
+        assert(strcmp(r_trailer, trailer) == 0);
+    }
+    /* At the end, nothing is read */
+    struct iovec last = {r_body, BODY};
+    assert(tfs_readv(f, &last, 1) == 0);
+    assert(tfs_readv(f, NULL, 0) == 0);
+
+    /* Plain reads see the gathered records, and short reads fill the
+     * first buffers */
+    assert(tfs_lseek(f, (off_t)record, TFS_SEEK_SET) == (off_t)record);
+    assert(tfs_read(f, r_header, HEADER) == HEADER);
+    assert(memcmp(r_header, "record 0001", HEADER) == 0);
+    assert(tfs_lseek(f, -5, TFS_SEEK_END) != -1);
+    memset(r_body, 0, BODY);
+    struct iovec tail[] = {{r_body, 2}, {r_trailer, sizeof(r_trailer)}};
+    assert(tfs_readv(f, tail, 2) == 5);
+    assert(r_body[0] == 'a' + (RECORDS - 1) % 26 && r_body[1] == 'e');
+    assert(strcmp(r_trailer, "nd") == 0);
+
+    /* Bad vectors */
+    assert(tfs_writev(f, &last, -1) == -1);
+    assert(tfs_readv(f, &last, -1) == -1);
+    struct iovec huge[] = {{r_body, SSIZE_MAX}, {r_body, SSIZE_MAX}};
+    assert(tfs_writev(f, huge, 2) == -1);
+
+    assert(tfs_close(a) != -1);
+    assert(tfs_close(f) != -1);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+/*  Reads a file with a hole in it through read views, checking that their
+    spans hold the same bytes as tfs_pread, then truncates the file while a
+    view is held and checks that the truncation waits for the release. */
+
+#define SIZE (20 * BLOCK_SIZE + 100)
+#define HOLE_START (3 * BLOCK_SIZE + 10)
+#define HOLE_END (7 * BLOCK_SIZE)
+
+static char data[SIZE], back[SIZE];
+static atomic_bool truncated;
+
+/* Compares the bytes of a view with the file contents, from an offset */
+static void check_view(tfs_view_t *view, size_t offset, size_t len) {
+    size_t done = 0;
+    for (int i = 0; i < view->v_count; i++) {
+        tfs_span_t *span = &view->v_spans[i];
+        if (span->vs_base == NULL) {
+            for (size_t j = 0; j < span->vs_len; j++) {
+                assert(data[offset + done + j] == 0);
+            }
+        } else {
+            assert(memcmp(span->vs_base, data + offset + done,
+                          span->vs_len) == 0);
+        }
+        done += span->vs_len;
+    }
+    assert(done == len);
+}
+
+static void *truncate_file(void *arg) {
+    (void)arg;
+    int f = tfs_open("/f", TFS_O_TRUNC);
+    assert(f != -1);
+    atomic_store(&truncated, true);
+    assert(tfs_close(f) != -1);
+    return NULL;
+}
+
+int main() {
+    tfs_view_t view;
+    pthread_t thread;
+
+    for (int i = 0; i < SIZE; i++) {
+        data[i] = (char)('a' + i % 26);
+    }
+    memset(data + HOLE_START, 0, HOLE_END - HOLE_START);
+
+    assert(tfs_init() != -1);
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_pwrite(f, data, HOLE_START, 0) == HOLE_START);
+    assert(tfs_pwrite(f, data + HOLE_END, SIZE - HOLE_END, HOLE_END) ==
+           SIZE - HOLE_END);
+    assert(tfs_pread(f, back, SIZE, 0) == SIZE);
+    assert(memcmp(back, data, SIZE) == 0);
+
+    /* Whole file, a part of it across the hole, and past the end */
+    assert(tfs_view(f, 0, SIZE, &view) == SIZE);
+    check_view(&view, 0, SIZE);
+    tfs_view_release(&view);
+    assert(tfs_view(f, BLOCK_SIZE + 5, 8 * BLOCK_SIZE, &view) ==
+           8 * BLOCK_SIZE);
+    check_view(&view, BLOCK_SIZE + 5, 8 * BLOCK_SIZE);
+    tfs_view_release(&view);
+    assert(tfs_view(f, SIZE - 10, 100, &view) == 10);
+    check_view(&view, SIZE - 10, 10);
+    tfs_view_release(&view);
+    assert(tfs_view(f, SIZE, 100, &view) == 0);
+    tfs_view_release(&view);
+    assert(tfs_view(f, -1, 100, &view) == -1);
+    tfs_view_release(&view);
+
+    /* The handle's offset did not move */
+    assert(tfs_lseek(f, 0, TFS_SEEK_CUR) == 0);
+
+    /* A truncation waits for the view to be released */
+    assert(tfs_view(f, 0, SIZE, &view) == SIZE);
+    assert(pthread_create(&thread, NULL, truncate_file, NULL) == 0);
+    struct timespec wait = {0, 100000000};
+    nanosleep(&wait, NULL);
+    assert(!atomic_load(&truncated));
+    check_view(&view, 0, SIZE);
+    tfs_view_release(&view);
+    assert(pthread_join(thread, NULL) == 0);
+    assert(atomic_load(&truncated));
+    assert(tfs_lseek(f, 0, TFS_SEEK_END) == 0);
+    assert(tfs_view(f, 0, SIZE, &view) == 0);
+    tfs_view_release(&view);
+
+    assert(tfs_close(f) != -1);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
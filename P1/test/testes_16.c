@@ -0,0 +1,109 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <string.h>
+
+/*  Maps a file written in one go (stored contiguously) and one whose blocks
+    are interleaved with another file's, writes through both mappings and
+    past the end of the files, and checks what reads see after the
+    mappings are released: only the bytes reported written are saved, and
+    mappings only read, or over holes, neither grow the file nor fill the
+    holes in. */
+
+#define BLOCKS (6)
+#define SIZE (BLOCKS * BLOCK_SIZE)
+
+static char data[SIZE], back[2 * SIZE];
+
+int main() {
+    tfs_map_t map;
+    tfs_view_t view;
+
+    for (int i = 0; i < SIZE; i++) {
+        data[i] = (char)('a' + i % 26);
+    }
+
+    assert(tfs_init() != -1);
+    int c = tfs_open("/contiguous", TFS_O_CREAT);
+    int f = tfs_open("/fragmented", TFS_O_CREAT);
+    int o = tfs_open("/other", TFS_O_CREAT);
+    assert(c != -1 && f != -1 && o != -1);
+    assert(tfs_write(c, data, SIZE) == SIZE);
+    for (int b = 0; b < BLOCKS; b++) {
+        assert(tfs_write(f, data + b * BLOCK_SIZE, BLOCK_SIZE) == BLOCK_SIZE);
+        assert(tfs_write(o, data, BLOCK_SIZE) == BLOCK_SIZE);
+    }
+
+    /* A contiguous file is mapped in place */
+    char *p = tfs_map(c, 100, SIZE - 200, &map);
+    assert(p != NULL && map.m_buffer == NULL);
+    assert(memcmp(p, data + 100, SIZE - 200) == 0);
+    memset(p, 'X', 10);
+    assert(tfs_unmap(&map, 10) == 0);
+    assert(tfs_view(c, 100, 10, &view) == 10);
+    assert(view.v_count == 1 && view.v_spans[0].vs_base == p);
+    tfs_view_release(&view);
+    assert(tfs_pread(c, back, SIZE, 0) == SIZE);
+    assert(memcmp(back + 100, "XXXXXXXXXX", 10) == 0);
+    assert(memcmp(back + 110, data + 110, SIZE - 110) == 0);
+
+    /* A fragmented one is mapped through a copy, written back on release */
+    p = tfs_map(f, BLOCK_SIZE / 2, 3 * BLOCK_SIZE, &map);
+    assert(p != NULL && map.m_buffer != NULL);
+    assert(memcmp(p, data + BLOCK_SIZE / 2, 3 * BLOCK_SIZE) == 0);
+    memset(p + BLOCK_SIZE, 'Y', BLOCK_SIZE);
+    assert(tfs_unmap(&map, 2 * BLOCK_SIZE) == 0);
+    assert(tfs_pread(f, back, SIZE, 0) == SIZE);
+    for (int i = 0; i < SIZE; i++) {
+        int in = i >= BLOCK_SIZE * 3 / 2 && i < BLOCK_SIZE * 5 / 2;
+        assert(back[i] == (in ? 'Y' : data[i]));
+    }
+
+    /* Past the end, bytes map to zeros and the file grows on release */
+    p = tfs_map(f, SIZE - 4, 3000, &map);
+    assert(p != NULL);
+    assert(memcmp(p, data + SIZE - 4, 4) == 0);
+    for (int i = 4; i < 3000; i++) {
+        assert(p[i] == 0);
+    }
+    memcpy(p + 2990, "tail", 4);
+    assert(tfs_lseek(f, 0, TFS_SEEK_END) == SIZE);
+    assert(tfs_unmap(&map, 2994) == 0);
+    assert(tfs_lseek(f, 0, TFS_SEEK_END) == SIZE - 4 + 2994);
+    assert(tfs_pread(f, back, 10, SIZE - 4 + 2990) == 4);
+    assert(memcmp(back, "tail", 4) == 0);
+
+    /* A mapping only read does not grow the file */
+    size_t end = SIZE - 4 + 2994;
+    assert(tfs_map(f, (off_t)end - 10, 5000, &map) != NULL);
+    assert(tfs_unmap(&map, 0) == 0);
+    assert(tfs_lseek(f, 0, TFS_SEEK_END) == (off_t)end);
+
+    /* Holes left as zeros stay holes: only the block written is stored */
+    int h = tfs_open("/holes", TFS_O_CREAT);
+    assert(h != -1);
+    assert(tfs_pwrite(h, "end", 3, 4 * BLOCK_SIZE) == 3);
+    int free_blocks = data_block_free_count();
+    p = tfs_map(h, 10, 4 * BLOCK_SIZE, &map);
+    assert(p != NULL && map.m_buffer != NULL);
+    memcpy(p + 2 * BLOCK_SIZE, "mid", 3);
+    assert(tfs_unmap(&map, 2 * BLOCK_SIZE + 3) == 0);
+    assert(data_block_free_count() == free_blocks - 1);
+    assert(tfs_lseek(h, 0, TFS_SEEK_END) == 4 * BLOCK_SIZE + 3);
+    assert(tfs_pread(h, back, 3, 2 * BLOCK_SIZE + 10) == 3);
+    assert(memcmp(back, "mid", 3) == 0);
+    assert(tfs_close(h) != -1);
+
+    /* Bad mappings */
+    assert(tfs_map(f, -1, 10, &map) == NULL);
+    assert(tfs_map(f, 0, 0, &map) == NULL);
+    assert(tfs_map(f, MAX_FILE_SIZE, 10, &map) == NULL);
+
+    assert(tfs_close(o) != -1);
+    assert(tfs_close(f) != -1);
+    assert(tfs_close(c) != -1);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
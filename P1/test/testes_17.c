@@ -0,0 +1,85 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*  Exports a file of half the disk, with holes in it (one at the start, one
+    spanning many blocks, one in the middle of a block) and spread over many
+    runs of blocks, and checks the exported copy byte by byte. */
+
+#define SIZE (DATA_BLOCKS / 2 * BLOCK_SIZE + 123)
+#define CHUNK (3 * BLOCK_SIZE + 17)
+
+static char const *dest = "/tmp/tfs_testes_17";
+
+/* The byte at a position of the file */
+static char expected(size_t i) {
+    if (i < 2 * BLOCK_SIZE || (i >= SIZE / 2 && i < SIZE / 2 + 100000) ||
+        (i >= SIZE - 3000 && i < SIZE - 2000)) {
+        return 0;
+    }
+    return (char)('a' + (i * 7) % 26);
+}
+
+int main() {
+    static char chunk[CHUNK], back[CHUNK];
+
+    assert(tfs_init() != -1);
+    int f = tfs_open("/f", TFS_O_CREAT);
+    int o = tfs_open("/other", TFS_O_CREAT);
+    assert(f != -1 && o != -1);
+
+    /* Written in chunks, skipping the holes, interleaved with another
+     * file so that the blocks are in many runs */
+    for (size_t at = 0; at < SIZE; at += CHUNK) {
+        size_t n = SIZE - at < CHUNK ? SIZE - at : CHUNK;
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] = expected(at + i);
+        }
+        size_t skip = 0;
+        while (skip < n && chunk[skip] == 0) {
+            skip++;
+        }
+        if (skip < n) {
+            assert(tfs_pwrite(f, chunk + skip, n - skip, (off_t)(at + skip)) ==
+                   (ssize_t)(n - skip));
+        }
+        assert(tfs_write(o, chunk, 100) == 100);
+    }
+    assert(tfs_lseek(f, 0, TFS_SEEK_END) == SIZE);
+
+    assert(tfs_copy_to_external_fs("/f", dest) == 0);
+
+    FILE *copy = fopen(dest, "r");
+    assert(copy != NULL);
+    size_t at = 0, n;
+    while ((n = fread(back, 1, CHUNK, copy)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            assert(back[i] == expected(at + i));
+        }
+        at += n;
+    }
+    assert(at == SIZE);
+    fclose(copy);
+
+    /* An empty file, and missing ones */
+    int e = tfs_open("/empty", TFS_O_CREAT);
+    assert(e != -1);
+    assert(tfs_copy_to_external_fs("/empty", dest) == 0);
+    copy = fopen(dest, "r");
+    assert(copy != NULL && fread(back, 1, 1, copy) == 0);
+    fclose(copy);
+    assert(tfs_copy_to_external_fs("/missing", dest) == -1);
+    assert(tfs_copy_to_external_fs("/f", "/missing/dir/file") == -1);
+    unlink(dest);
+
+    assert(tfs_close(e) != -1);
+    assert(tfs_close(o) != -1);
+    assert(tfs_close(f) != -1);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*  Exports a file with holes in it, spread over many runs of blocks, with
+    different numbers of threads (more than the file has blocks, too), and
+    checks every exported copy byte by byte. */
+
+#define SIZE (DATA_BLOCKS / 4 * BLOCK_SIZE + 321)
+#define CHUNK (2 * BLOCK_SIZE + 9)
+
+static char const *dest = "/tmp/tfs_testes_18";
+static int const workers[] = {1, 2, 3, 8, 5000};
+
+#define RUNS (sizeof(workers) / sizeof(workers[0]))
+
+/* The byte at a position of the file */
+static char expected(size_t i) {
+    if (i < 5000 || (i >= SIZE / 3 && i < SIZE / 3 + 50000) ||
+        i >= SIZE - 700) {
+        return 0;
+    }
+    return (char)('A' + (i * 13) % 26);
+}
+
+static void check_copy(size_t size) {
+    static char back[CHUNK];
+    FILE *copy = fopen(dest, "r");
+    assert(copy != NULL);
+    size_t at = 0, n;
+    while ((n = fread(back, 1, CHUNK, copy)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            assert(back[i] == expected(at + i));
+        }
+        at += n;
+    }
+    assert(at == size);
+    fclose(copy);
+}
+
+int main() {
+    static char chunk[CHUNK];
+
+    assert(tfs_init() != -1);
+    int f = tfs_open("/f", TFS_O_CREAT);
+    int o = tfs_open("/other", TFS_O_CREAT);
+    assert(f != -1 && o != -1);
+
+    /* Written in chunks, skipping the holes (the one at the end is left by
+     * a last write of zeros), interleaved with another file */
+    for (size_t at = 0; at < SIZE; at += CHUNK) {
+        size_t n = SIZE - at < CHUNK ? SIZE - at : CHUNK;
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] = expected(at + i);
+        }
+        if (at + n == SIZE || chunk[0] != 0 || chunk[n - 1] != 0) {
+            assert(tfs_pwrite(f, chunk, n, (off_t)at) == (ssize_t)n);
+        }
+        assert(tfs_write(o, chunk, 10) == 10);
+    }
+    assert(tfs_lseek(f, 0, TFS_SEEK_END) == SIZE);
+
+    for (size_t r = 0; r < RUNS; r++) {
+        assert(tfs_copy_to_external_fs_parallel("/f", dest, workers[r]) == 0);
+        check_copy(SIZE);
+    }
+
+    /* An empty file, and bad calls */
+    int e = tfs_open("/empty", TFS_O_CREAT);
+    assert(e != -1);
+    assert(tfs_copy_to_external_fs_parallel("/empty", dest, 4) == 0);
+    check_copy(0);
+    assert(tfs_copy_to_external_fs_parallel("/f", dest, 0) == -1);
+    assert(tfs_copy_to_external_fs_parallel("/missing", dest, 2) == -1);
+    assert(tfs_copy_to_external_fs_parallel("/f", "/missing/dir/file", 2) ==
+           -1);
+    unlink(dest);
+
+    assert(tfs_close(e) != -1);
+    assert(tfs_close(o) != -1);
+    assert(tfs_close(f) != -1);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
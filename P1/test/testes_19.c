@@ -0,0 +1,95 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*  Imports host files (one of half the disk, an empty one, over an existing
+    file) into TecnicoFS, checks their contents and that a large file is
+    stored in a single run of blocks, and exports one back. */
+
+#define SIZE (DATA_BLOCKS / 2 * BLOCK_SIZE + 77)
+#define CHUNK (4096)
+
+static char const *source = "/tmp/tfs_testes_19";
+static char const *back_path = "/tmp/tfs_testes_19_back";
+
+static char expected(size_t i) { return (char)('a' + (i * 11 + i / 997) % 26); }
+
+static void write_host_file(char const *path, size_t size) {
+    static char chunk[CHUNK];
+    FILE *f = fopen(path, "w");
+    assert(f != NULL);
+    for (size_t at = 0; at < size; at += CHUNK) {
+        size_t n = size - at < CHUNK ? size - at : CHUNK;
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] = expected(at + i);
+        }
+        assert(fwrite(chunk, 1, n, f) == n);
+    }
+    fclose(f);
+}
+
+int main() {
+    static char buffer[CHUNK];
+    tfs_view_t view;
+
+    write_host_file(source, SIZE);
+    assert(tfs_init() != -1);
+
+    /* Over an existing file, which is truncated first */
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, "old contents", 12) == 12);
+    assert(tfs_close(f) != -1);
+    assert(tfs_copy_from_external_fs(source, "/f") == 0);
+
+    f = tfs_open("/f", 0);
+    assert(f != -1);
+    assert(tfs_lseek(f, 0, TFS_SEEK_END) == SIZE);
+    assert(tfs_lseek(f, 0, TFS_SEEK_SET) == 0);
+    for (size_t at = 0; at < SIZE; at += CHUNK) {
+        ssize_t n = tfs_read(f, buffer, CHUNK);
+        assert(n == (ssize_t)(SIZE - at < CHUNK ? SIZE - at : CHUNK));
+        for (ssize_t i = 0; i < n; i++) {
+            assert(buffer[i] == expected(at + (size_t)i));
+        }
+    }
+    /* On an empty disk, the blocks were allocated as one run */
+    assert(tfs_view(f, 0, SIZE, &view) == SIZE);
+    assert(view.v_count == 1);
+    tfs_view_release(&view);
+    assert(tfs_close(f) != -1);
+
+    /* Round trip */
+    assert(tfs_copy_to_external_fs("/f", back_path) == 0);
+    FILE *a = fopen(source, "r"), *b = fopen(back_path, "r");
+    assert(a != NULL && b != NULL);
+    static char other[CHUNK];
+    size_t n;
+    while ((n = fread(buffer, 1, CHUNK, a)) > 0) {
+        assert(fread(other, 1, CHUNK, b) == n);
+        assert(memcmp(buffer, other, n) == 0);
+    }
+    assert(fread(other, 1, 1, b) == 0);
+    fclose(a);
+    fclose(b);
+
+    /* An empty file, and bad calls */
+    write_host_file(source, 0);
+    assert(tfs_copy_from_external_fs(source, "/empty") == 0);
+    f = tfs_open("/empty", 0);
+    assert(f != -1 && tfs_lseek(f, 0, TFS_SEEK_END) == 0);
+    assert(tfs_close(f) != -1);
+    assert(tfs_copy_from_external_fs("/tmp/tfs_missing_file", "/g") == -1);
+    assert(tfs_copy_from_external_fs("/tmp", "/g") == -1);
+    assert(tfs_copy_from_external_fs(source, "no_slash") == -1);
+    unlink(source);
+    unlink(back_path);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
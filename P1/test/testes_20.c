@@ -0,0 +1,167 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+
+/*  Opens files, writes and reads them back through the asynchronous
+    interface, keeping hundreds of operations in flight, and checks that
+    a submission is cut short when the rings are full. Then restarts the
+    interface while another thread stops it. */
+
+#define WORKERS (8)
+#define FILES (4)
+#define RECORDS (300)
+#define RECORD (100)
+
+static char records[FILES][RECORDS][RECORD];
+static char back[FILES][RECORDS][RECORD];
+static tfs_sqe_t sqes[FILES * RECORDS];
+static tfs_cqe_t cqes[FILES * RECORDS];
+
+/* Submits count entries, reaping whatever completes while the rings are
+ * full; returns the number of completions reaped on the way */
+static int submit_all(tfs_sqe_t const *entries, int count, tfs_cqe_t *done) {
+    int reaped = 0;
+    while (count > 0) {
+        int n = tfs_submit(entries, count);
+        assert(n >= 0);
+        entries += n;
+        count -= n;
+        if (count > 0) {
+            int r = tfs_reap(done + reaped, FILES * RECORDS - reaped, 1);
+            assert(r >= 1);
+            reaped += r;
+        }
+    }
+    return reaped;
+}
+
+static void *stopper(void *arg) {
+    *(int *)arg = tfs_async_stop();
+    return NULL;
+}
+
+static void reap_all(tfs_cqe_t *done, int reaped, int count) {
+    while (reaped < count) {
+        int r = tfs_reap(done + reaped, count - reaped, 1);
+        assert(r >= 1);
+        reaped += r;
+    }
+}
+
+int main() {
+    char const *names[FILES] = {"/a", "/b", "/c", "/d"};
+    int handles[FILES];
+
+    assert(tfs_init() != -1);
+    assert(tfs_submit(sqes, 0) == -1);
+    assert(tfs_async_start(0) == -1);
+    assert(tfs_async_start(WORKERS) == 0);
+    assert(tfs_async_start(WORKERS) == -1);
+
+    /* Opens, from a single entry whose name is overwritten as soon as it
+     * is submitted */
+    memset(&sqes[0], 0, sizeof(sqes[0]));
+    sqes[0].sq_op = TFS_OP_OPEN;
+    sqes[0].sq_flags = TFS_O_CREAT;
+    for (int f = 0; f < FILES; f++) {
+        strcpy(sqes[0].sq_name, names[f]);
+        sqes[0].sq_user_data = (uint64_t)f;
+        assert(tfs_submit(sqes, 1) == 1);
+        strcpy(sqes[0].sq_name, "/overwritten");
+    }
+    assert(tfs_reap(cqes, FILES, FILES) == FILES);
+    for (int f = 0; f < FILES; f++) {
+        assert(cqes[f].cq_result != -1);
+        handles[cqes[f].cq_user_data] = (int)cqes[f].cq_result;
+        assert(tfs_lookup(names[f]) != -1);
+    }
+    assert(tfs_lookup("/overwritten") == -1);
+
+    /* A name that does not end within sq_name */
+    memset(sqes[0].sq_name, 'x', sizeof(sqes[0].sq_name));
+    assert(tfs_submit(sqes, 1) == -1);
+    assert(tfs_reap(cqes, 1, 1) == 0);
+
+    /* Writes at their own offsets, more than the rings hold */
+    for (int f = 0; f < FILES; f++) {
+        for (int r = 0; r < RECORDS; r++) {
+            tfs_sqe_t *sqe = &sqes[f * RECORDS + r];
+            memset(records[f][r], 'A' + (f + r) % 26, RECORD);
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->sq_op = TFS_OP_WRITE;
+            sqe->sq_fhandle = handles[f];
+            sqe->sq_buffer = records[f][r];
+            sqe->sq_len = RECORD;
+            sqe->sq_offset = (off_t)r * RECORD;
+            sqe->sq_user_data = (uint64_t)(f * RECORDS + r);
+        }
+    }
+    assert(FILES * RECORDS > ASYNC_RING_SIZE);
+    reap_all(cqes, submit_all(sqes, FILES * RECORDS, cqes),
+             FILES * RECORDS);
+    for (int i = 0; i < FILES * RECORDS; i++) {
+        assert(cqes[i].cq_result == RECORD);
+    }
+
+    /* Reads them back */
+    for (int i = 0; i < FILES * RECORDS; i++) {
+        sqes[i].sq_op = TFS_OP_READ;
+        sqes[i].sq_buffer = back[i / RECORDS][i % RECORDS];
+    }
+    reap_all(cqes, submit_all(sqes, FILES * RECORDS, cqes),
+             FILES * RECORDS);
+    for (int i = 0; i < FILES * RECORDS; i++) {
+        assert(cqes[i].cq_result == RECORD);
+    }
+    assert(memcmp(back, records, sizeof(records)) == 0);
+
+    /* Reading at the handle's offset */
+    sqes[0].sq_offset = -1;
+    assert(tfs_submit(sqes, 1) == 1);
+    assert(tfs_reap(cqes, 1, 1) == 1);
+    assert(cqes[0].cq_result == RECORD);
+    assert(tfs_lseek(handles[0], 0, TFS_SEEK_CUR) == RECORD);
+
+    /* Nothing in flight: reaping does not wait */
+    assert(tfs_reap(cqes, 1, 1) == 0);
+    assert(tfs_reap(cqes, 1, 2) == -1);
+
+    /* Closes, left queued when the interface stops */
+    for (int f = 0; f < FILES; f++) {
+        memset(&sqes[f], 0, sizeof(sqes[f]));
+        sqes[f].sq_op = TFS_OP_CLOSE;
+        sqes[f].sq_fhandle = handles[f];
+    }
+    assert(tfs_submit(sqes, FILES) == FILES);
+    assert(tfs_async_stop() == 0);
+    assert(tfs_async_stop() == -1);
+    assert(tfs_submit(sqes, 1) == -1);
+    for (int f = 0; f < FILES; f++) {
+        assert(tfs_close(handles[f]) == -1);
+    }
+
+    /* Starting fails until a stop in progress has joined its workers */
+    assert(tfs_async_start(WORKERS) == 0);
+    for (int i = 0; i < ASYNC_RING_SIZE; i++) {
+        memset(&sqes[i], 0, sizeof(sqes[i]));
+        sqes[i].sq_op = TFS_OP_OPEN;
+        strcpy(sqes[i].sq_name, "/missing");
+    }
+    assert(tfs_submit(sqes, ASYNC_RING_SIZE) == ASYNC_RING_SIZE);
+    pthread_t thread;
+    int stopped = -1;
+    assert(pthread_create(&thread, NULL, stopper, &stopped) == 0);
+    while (tfs_async_start(WORKERS) == -1) {
+    }
+    assert(pthread_join(thread, NULL) == 0);
+    assert(stopped == 0);
+    assert(tfs_reap(cqes, 1, 1) == 0);
+    assert(tfs_async_stop() == 0);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
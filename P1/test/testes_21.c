@@ -0,0 +1,72 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+
+/*  Threads open the same names with TFS_O_CREAT at once: every open
+    succeeds, and they all get the same file. Racing tfs_mkdir calls on a
+    name leave exactly one of them successful. */
+
+#define THREADS (4)
+#define ROUNDS (100)
+#define NAMES (10)
+
+static int mkdirs_ok;
+static pthread_mutex_t mkdirs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *worker(void *arg) {
+    char id = *(char *)arg;
+    char name[16];
+
+    for (int n = 0; n < NAMES; n++) {
+        snprintf(name, sizeof(name), "/f%d", n);
+        int f = tfs_open(name, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_pwrite(f, &id, 1, id) == 1);
+        assert(tfs_close(f) != -1);
+
+        snprintf(name, sizeof(name), "/d%d", n);
+        if (tfs_mkdir(name) != -1) {
+            pthread_mutex_lock(&mkdirs_mutex);
+            mkdirs_ok++;
+            pthread_mutex_unlock(&mkdirs_mutex);
+        }
+    }
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[THREADS];
+    char ids[THREADS];
+    char name[16], back[THREADS + 1];
+
+    for (int round = 0; round < ROUNDS; round++) {
+        assert(tfs_init() != -1);
+        mkdirs_ok = 0;
+        for (int i = 0; i < THREADS; i++) {
+            ids[i] = (char)i;
+            assert(pthread_create(&threads[i], NULL, worker, &ids[i]) == 0);
+        }
+        for (int i = 0; i < THREADS; i++) {
+            assert(pthread_join(threads[i], NULL) == 0);
+        }
+
+        /* Each file holds what every thread wrote to it */
+        for (int n = 0; n < NAMES; n++) {
+            snprintf(name, sizeof(name), "/f%d", n);
+            int f = tfs_open(name, 0);
+            assert(f != -1);
+            assert(tfs_read(f, back, sizeof(back)) == THREADS);
+            for (int i = 0; i < THREADS; i++) {
+                assert(back[i] == i);
+            }
+            assert(tfs_close(f) != -1);
+        }
+        assert(mkdirs_ok == NAMES);
+        assert(tfs_destroy() != -1);
+    }
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/*  Appends to a file until the disk fills up: the append that is cut short
+    gives back the bytes it reserved and did not write, so the file ends
+    where it stopped and the next append goes right after it. */
+
+#define CHUNK (64 * BLOCK_SIZE)
+
+static char chunk[CHUNK];
+
+int main() {
+    char buffer[BLOCK_SIZE];
+
+    assert(tfs_init() != -1);
+
+    /* One byte, so that the rest of its block is already allocated */
+    int f = tfs_open("/log", TFS_O_CREAT | TFS_O_APPEND);
+    assert(f != -1);
+    assert(tfs_write(f, "a", 1) == 1);
+
+    /* Fills the disk */
+    int fill = tfs_open("/fill", TFS_O_CREAT);
+    assert(fill != -1);
+    memset(chunk, 'f', sizeof(chunk));
+    while (tfs_write(fill, chunk, sizeof(chunk)) == sizeof(chunk)) {
+    }
+    assert(tfs_write(fill, chunk, 1) == -1);
+
+    /* Only the rest of the allocated block is written */
+    memset(chunk, 'b', sizeof(chunk));
+    assert(tfs_write(f, chunk, 3 * BLOCK_SIZE) == BLOCK_SIZE - 1);
+    assert(tfs_lseek(f, 0, TFS_SEEK_END) == BLOCK_SIZE);
+    assert(tfs_write(f, chunk, 1) == -1);
+    assert(tfs_lseek(f, 0, TFS_SEEK_END) == BLOCK_SIZE);
+
+    /* Makes room again */
+    assert(tfs_close(fill) != -1);
+    fill = tfs_open("/fill", TFS_O_TRUNC);
+    assert(fill != -1);
+    assert(tfs_close(fill) != -1);
+
+    assert(tfs_write(f, "c", 1) == 1);
+    assert(tfs_lseek(f, 0, TFS_SEEK_END) == BLOCK_SIZE + 1);
+    assert(tfs_pread(f, buffer, 2, BLOCK_SIZE - 1) == 2);
+    assert(buffer[0] == 'b' && buffer[1] == 'c');
+    assert(tfs_close(f) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
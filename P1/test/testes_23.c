@@ -0,0 +1,129 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+/*  Threads allocate and free data blocks at the same time, freeing blocks
+    allocated by other threads too (so that blocks move between their
+    magazines): no block is handed out twice, and every block is free again
+    once the threads are gone. Then checks that a file written in one go
+    still gets contiguous blocks when the only free ones sit in the
+    writing thread's magazine. */
+
+#define THREADS (8)
+#define ROUNDS (200)
+#define HELD (24)
+#define RUN (8)
+
+static atomic_bool taken[DATA_BLOCKS];
+/* Blocks left by a thread for another one to free */
+static int pool[THREADS * HELD];
+static int pooled;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void block_free(int block) {
+    assert(atomic_exchange(&taken[block], false));
+    assert(data_block_free(block) == 0);
+}
+
+static void *worker(void *arg) {
+    int id = *(int *)arg;
+    int held[HELD];
+
+    for (int r = 0; r < ROUNDS; r++) {
+        int n = 1 + (id + r) % HELD;
+        for (int i = 0; i < n; i++) {
+            held[i] = data_block_alloc();
+            assert(held[i] != -1);
+            assert(!atomic_exchange(&taken[held[i]], true));
+        }
+        /* Swaps half of them for blocks of other threads */
+        pthread_mutex_lock(&pool_mutex);
+        for (int i = 0; i < n / 2; i++) {
+            int other = pooled > 0 ? pool[--pooled] : -1;
+            pool[pooled++] = held[i];
+            held[i] = other;
+        }
+        pthread_mutex_unlock(&pool_mutex);
+        for (int i = 0; i < n; i++) {
+            if (held[i] != -1) {
+                block_free(held[i]);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void *pool_free(void *arg) {
+    (void)arg;
+    for (int i = 0; i < pooled; i++) {
+        block_free(pool[i]);
+    }
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[THREADS];
+    int ids[THREADS];
+    static bool mine[DATA_BLOCKS];
+    tfs_map_t map;
+
+    assert(tfs_init() != -1);
+    int free_blocks = data_block_free_count();
+
+    for (int t = 0; t < THREADS; t++) {
+        ids[t] = t;
+        assert(pthread_create(&threads[t], NULL, worker, &ids[t]) == 0);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        assert(pthread_join(threads[t], NULL) == 0);
+    }
+    /* Exiting threads give back what their magazines hold */
+    assert(pthread_create(&threads[0], NULL, pool_free, NULL) == 0);
+    assert(pthread_join(threads[0], NULL) == 0);
+    assert(data_block_free_count() == free_blocks);
+
+    /* Takes the whole disk, then frees a run into the magazine only */
+    int b;
+    while ((b = data_block_alloc()) != -1) {
+        mine[b] = true;
+    }
+    int first = 0;
+    for (int i = 0; i < DATA_BLOCKS && first + RUN <= DATA_BLOCKS; i++) {
+        if (!mine[i]) {
+            first = i + 1;
+        } else if (i + 1 - first == RUN) {
+            break;
+        }
+    }
+    assert(first + RUN <= DATA_BLOCKS);
+    for (int i = first; i < first + RUN; i++) {
+        mine[i] = false;
+        assert(data_block_free(i) == 0);
+    }
+    assert(data_block_free_count() == 0);
+
+    static char data[RUN * BLOCK_SIZE];
+    memset(data, 'r', sizeof(data));
+    int f = tfs_open("/run", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, data, sizeof(data)) == sizeof(data));
+    /* Mapped in place: the blocks are contiguous */
+    assert(tfs_map(f, 0, sizeof(data), &map) != NULL);
+    assert(map.m_buffer == NULL);
+    assert(tfs_unmap(&map, 0) == 0);
+    assert(tfs_close(f) != -1);
+
+    for (int i = 0; i < DATA_BLOCKS; i++) {
+        if (mine[i]) {
+            assert(data_block_free(i) == 0);
+        }
+    }
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+/*  Threads claim i-nodes and data blocks at the same time until none is
+    left, recording every number they get: none is handed out twice, and
+    together they get every free one. They then give them all back, twice
+    over. Run it with the lock-free allocators and with make ALLOC=mutex. */
+
+#define THREADS (8)
+#define ROUNDS (2)
+
+static atomic_bool inode_taken[INODE_TABLE_SIZE];
+static atomic_bool block_taken[DATA_BLOCKS];
+static atomic_int inodes_claimed, blocks_claimed;
+
+typedef struct {
+    int inodes[INODE_TABLE_SIZE];
+    int blocks[DATA_BLOCKS];
+    int inode_count, block_count;
+} claims_t;
+
+static claims_t claims[THREADS];
+
+static void *claimer(void *arg) {
+    claims_t *mine = (claims_t *)arg;
+    int inumber, block;
+
+    mine->inode_count = 0;
+    mine->block_count = 0;
+    while ((inumber = inode_create(T_FILE)) != -1) {
+        assert(!atomic_exchange(&inode_taken[inumber], true));
+        mine->inodes[mine->inode_count++] = inumber;
+    }
+    while ((block = data_block_alloc()) != -1) {
+        assert(!atomic_exchange(&block_taken[block], true));
+        mine->blocks[mine->block_count++] = block;
+    }
+    atomic_fetch_add(&inodes_claimed, mine->inode_count);
+    atomic_fetch_add(&blocks_claimed, mine->block_count);
+    return NULL;
+}
+
+static void *releaser(void *arg) {
+    claims_t *mine = (claims_t *)arg;
+
+    for (int i = 0; i < mine->inode_count; i++) {
+        atomic_store(&inode_taken[mine->inodes[i]], false);
+        assert(inode_delete(mine->inodes[i]) == 0);
+    }
+    for (int i = 0; i < mine->block_count; i++) {
+        atomic_store(&block_taken[mine->blocks[i]], false);
+        assert(data_block_free(mine->blocks[i]) == 0);
+    }
+    return NULL;
+}
+
+static void run(void *(*routine)(void *)) {
+    pthread_t threads[THREADS];
+
+    for (int t = 0; t < THREADS; t++) {
+        assert(pthread_create(&threads[t], NULL, routine, &claims[t]) == 0);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        assert(pthread_join(threads[t], NULL) == 0);
+    }
+}
+
+int main() {
+    assert(tfs_init() != -1);
+    int free_blocks = data_block_free_count();
+
+    for (int r = 0; r < ROUNDS; r++) {
+        atomic_store(&inodes_claimed, 0);
+        atomic_store(&blocks_claimed, 0);
+        run(claimer);
+        /* Only the root directory was taken before */
+        assert(atomic_load(&inodes_claimed) == INODE_TABLE_SIZE - 1);
+        assert(atomic_load(&blocks_claimed) == free_blocks);
+        assert(data_block_free_count() == 0);
+
+        /* The magazines of exiting threads go back as well */
+        run(releaser);
+        assert(data_block_free_count() == free_blocks);
+    }
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+
+/*  Writes large files, both with a single call and with smaller
+    writes from several threads, and checks their contents when read
+    back. Two files written block by block in alternation fragment the
+    disk, which forces them out of extents into block pointers. */
+
+#define THREADS (4)
+#define FILE_BYTES (150 * 1024)
+#define WRITE_CHUNK (3000)
+#define READ_CHUNK (5000)
+
+static char pattern(int file, size_t i) {
+    return (char)('A' + (file * 7 + (int)(i % 251)) % 26);
+}
+
+static void check_file(char const *path, int file, size_t size) {
+    static char buffer[READ_CHUNK];
+    size_t done = 0;
+
+    int f = tfs_open(path, 0);
+    assert(f != -1);
+    for (;;) {
+        ssize_t r = tfs_read(f, buffer, sizeof(buffer));
+        assert(r != -1);
+        if (r == 0) {
+            break;
+        }
+        for (size_t i = 0; i < (size_t)r; i++) {
+            assert(buffer[i] == pattern(file, done + i));
+        }
+        done += (size_t)r;
+    }
+    assert(done == size);
+    assert(tfs_close(f) != -1);
+}
+
+void *tfs_write_chunks(void *arg) {
+    int file = *(int *)arg;
+    char path[8] = "/f0";
+    char buffer[WRITE_CHUNK];
+
+    path[2] = (char)('0' + file);
+    int f = tfs_open(path, TFS_O_CREAT);
+    assert(f != -1);
+    for (size_t done = 0; done < FILE_BYTES; done += WRITE_CHUNK) {
+        size_t len = FILE_BYTES - done < WRITE_CHUNK ? FILE_BYTES - done
+                                                     : WRITE_CHUNK;
+        for (size_t i = 0; i < len; i++) {
+            buffer[i] = pattern(file, done + i);
+        }
+        assert(tfs_write(f, buffer, len) == len);
+    }
+    assert(tfs_close(f) != -1);
+    return NULL;
+}
+
+int main() {
+    static char big[FILE_BYTES];
+    pthread_t threads[THREADS];
+    int files[THREADS];
+
+    assert(tfs_init() != -1);
+
+    /* One large write */
+    for (size_t i = 0; i < FILE_BYTES; i++) {
+        big[i] = pattern(THREADS, i);
+    }
+    int f = tfs_open("/big", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, big, FILE_BYTES) == FILE_BYTES);
+    assert(tfs_close(f) != -1);
+    check_file("/big", THREADS, FILE_BYTES);
+
+    /* Interleaved writes to several files */
+    for (int i = 0; i < THREADS; i++) {
+        files[i] = i;
+        assert(pthread_create(&threads[i], NULL, tfs_write_chunks,
+                              &files[i]) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        char path[8] = "/f0";
+        path[2] = (char)('0' + i);
+        check_file(path, i, FILE_BYTES);
+    }
+
+    /* Alternating block-sized writes to two files */
+    int a = tfs_open("/a", TFS_O_CREAT);
+    int b = tfs_open("/b", TFS_O_CREAT);
+    assert(a != -1 && b != -1);
+    for (size_t done = 0; done < 20 * BLOCK_SIZE; done += BLOCK_SIZE) {
+        char block[BLOCK_SIZE];
+        for (size_t i = 0; i < BLOCK_SIZE; i++) {
+            block[i] = pattern(THREADS + 1, done + i);
+        }
+        assert(tfs_write(a, block, BLOCK_SIZE) == BLOCK_SIZE);
+        for (size_t i = 0; i < BLOCK_SIZE; i++) {
+            block[i] = pattern(THREADS + 2, done + i);
+        }
+        assert(tfs_write(b, block, BLOCK_SIZE) == BLOCK_SIZE);
+    }
+    assert(tfs_close(a) != -1);
+    assert(tfs_close(b) != -1);
+    check_file("/a", THREADS + 1, 20 * BLOCK_SIZE);
+    check_file("/b", THREADS + 2, 20 * BLOCK_SIZE);
+
+    /* Truncating gives the blocks back */
+    f = tfs_open("/big", TFS_O_TRUNC);
+    assert(f != -1);
+    assert(tfs_close(f) != -1);
+    f = tfs_open("/big", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, big, FILE_BYTES) == FILE_BYTES);
+    assert(tfs_close(f) != -1);
+    check_file("/big", THREADS, FILE_BYTES);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
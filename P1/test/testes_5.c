@@ -0,0 +1,70 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <string.h>
+
+/*  Checks sparse files: seeking past the end and writing leaves a
+    hole that reads as zeros and takes no data blocks. The disk is
+    dirtied first, so that blocks filled in later must be zeroed. */
+
+#define HOLE (200 * 1024 + 10)
+
+static void assert_zeros(char const *buffer, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        assert(buffer[i] == 0);
+    }
+}
+
+int main() {
+    static char buffer[HOLE + 100];
+    char *tail = "tail";
+    char *mid = "mid";
+
+    assert(tfs_init() != -1);
+
+    /* Dirty the disk and give the blocks back */
+    memset(buffer, 'x', sizeof(buffer));
+    int f = tfs_open("/dirty", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, buffer, HOLE) == HOLE);
+    assert(tfs_close(f) != -1);
+    f = tfs_open("/dirty", TFS_O_TRUNC);
+    assert(f != -1);
+    assert(tfs_close(f) != -1);
+
+    int free_blocks = data_block_free_count();
+
+    /* Write past a hole */
+    f = tfs_open("/sparse", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_lseek(f, HOLE, TFS_SEEK_SET) == HOLE);
+    assert(tfs_write(f, tail, strlen(tail)) == strlen(tail));
+    assert(tfs_lseek(f, 0, TFS_SEEK_END) == HOLE + strlen(tail));
+    /* Only the block holding the tail was allocated */
+    assert(free_blocks - data_block_free_count() <= 1);
+
+    /* Fill a few bytes in the middle of the hole */
+    assert(tfs_lseek(f, 5000, TFS_SEEK_SET) == 5000);
+    assert(tfs_write(f, mid, strlen(mid)) == strlen(mid));
+    assert(tfs_lseek(f, -(off_t)strlen(mid), TFS_SEEK_CUR) == 5000);
+    assert(tfs_close(f) != -1);
+
+    /* Read everything back */
+    f = tfs_open("/sparse", 0);
+    assert(f != -1);
+    memset(buffer, 'x', sizeof(buffer));
+    assert(tfs_read(f, buffer, sizeof(buffer)) == HOLE + strlen(tail));
+    assert_zeros(buffer, 5000);
+    assert(memcmp(buffer + 5000, mid, strlen(mid)) == 0);
+    assert_zeros(buffer + 5000 + strlen(mid), HOLE - 5000 - strlen(mid));
+    assert(memcmp(buffer + HOLE, tail, strlen(tail)) == 0);
+
+    /* Bad offsets */
+    assert(tfs_lseek(f, -1, TFS_SEEK_SET) == -1);
+    assert(tfs_lseek(f, MAX_FILE_SIZE + 1, TFS_SEEK_SET) == -1);
+    assert(tfs_lseek(f, 0, 42) == -1);
+    assert(tfs_close(f) != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <string.h>
+
+/*  Writes a few bytes at the edges of every level of block pointers (direct,
+    single, double and triple indirect), enough separate places to leave
+    the extents behind, and reads them back. Truncating must give back the
+    pointer blocks too, so repeating it does not leak blocks. */
+
+#define P ((int)MAX_BLOCK_POINTERS)
+#define D DIRECT_BLOCK_POINTERS
+
+static int const lblocks[] = {
+    0,                 /* direct */
+    D,                 /* first single indirect */
+    D + P - 1,         /* last single indirect */
+    D + P,             /* first double indirect */
+    D + P + P * P - 1, /* last double indirect */
+    D + P + P * P,     /* first triple indirect */
+    MAX_FILE_BLOCKS - 1,
+};
+
+#define COUNT (sizeof(lblocks) / sizeof(lblocks[0]))
+
+static void write_all(char const *path) {
+    int f = tfs_open(path, TFS_O_CREAT | TFS_O_TRUNC);
+    assert(f != -1);
+    for (size_t i = 0; i < COUNT; i++) {
+        off_t offset = (off_t)lblocks[i] * BLOCK_SIZE + 7;
+        char byte = (char)('a' + i);
+        assert(tfs_lseek(f, offset, TFS_SEEK_SET) == offset);
+        assert(tfs_write(f, &byte, 1) == 1);
+    }
+    assert(tfs_close(f) != -1);
+}
+
+int main() {
+    char *path = "/f1";
+    char buffer[2 * BLOCK_SIZE];
+
+    assert(tfs_init() != -1);
+
+    write_all(path);
+
+    int f = tfs_open(path, 0);
+    assert(f != -1);
+    for (size_t i = 0; i < COUNT; i++) {
+        /* Reads the block before too when it is a hole */
+        off_t offset = (off_t)lblocks[i] * BLOCK_SIZE + 7;
+        off_t start = (off_t)lblocks[i] * BLOCK_SIZE;
+        if (i > 0 && lblocks[i - 1] != lblocks[i] - 1) {
+            start -= BLOCK_SIZE;
+        }
+        assert(tfs_lseek(f, start, TFS_SEEK_SET) == start);
+        ssize_t r = tfs_read(f, buffer, (size_t)(offset - start) + 1);
+        assert(r == offset - start + 1);
+        for (ssize_t j = 0; j < r - 1; j++) {
+            assert(buffer[j] == 0);
+        }
+        assert(buffer[r - 1] == 'a' + (char)i);
+    }
+
+    /* The file ends at the largest size */
+    assert(tfs_lseek(f, -1, TFS_SEEK_END) == MAX_FILE_SIZE - BLOCK_SIZE + 7);
+    assert(tfs_lseek(f, MAX_FILE_SIZE - 4, TFS_SEEK_SET) == MAX_FILE_SIZE - 4);
+    assert(tfs_write(f, "12345678", 8) == 4);
+    assert(tfs_write(f, "9", 1) == 0);
+    assert(tfs_close(f) != -1);
+
+    int free_blocks = data_block_free_count();
+    for (int i = 0; i < 50; i++) {
+        write_all(path);
+    }
+    /* Freed blocks may still sit in this thread's magazine */
+    assert(free_blocks - data_block_free_count() <= MAGAZINE_SIZE);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
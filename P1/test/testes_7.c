@@ -0,0 +1,69 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <string.h>
+
+/*  Grows the root directory to many blocks, looks every name up (and a
+    few missing ones), then removes some entries and checks the remaining
+    names are still found and freed entries are reused. Entries are added
+    straight to the directory, so that they need not have i-nodes of their
+    own. */
+
+#define ENTRIES (5000)
+#define CLEARED (250) /* every CLEARED-th entry is removed */
+#define KEPT_INUMBERS (INODE_TABLE_SIZE - 1 - ENTRIES / CLEARED)
+
+static void name_of(char *path, size_t i) {
+    sprintf(path, "/file%zu", i);
+}
+
+/* Entries that are removed get an i-number of their own, which is how
+ * clear_dir_entry() finds them */
+static int inumber_of(size_t i) {
+    if (i % CLEARED == 0) {
+        return 1 + (int)(i / CLEARED);
+    }
+    return 1 + ENTRIES / CLEARED + (int)(i % KEPT_INUMBERS);
+}
+
+int main() {
+    char path[MAX_FILE_NAME];
+    static int inumbers[ENTRIES];
+
+    assert(tfs_init() != -1);
+
+    for (size_t i = 0; i < ENTRIES; i++) {
+        name_of(path, i);
+        inumbers[i] = inumber_of(i);
+        assert(add_dir_entry(ROOT_DIR_INUM, inumbers[i], path + 1) == 0);
+    }
+
+    for (size_t i = 0; i < ENTRIES; i++) {
+        name_of(path, i);
+        assert(find_in_dir(ROOT_DIR_INUM, path + 1) == inumbers[i]);
+    }
+    assert(tfs_lookup("/file") == -1);
+    assert(tfs_lookup("/file00") == -1);
+    assert(tfs_lookup("/missing") == -1);
+    /* Names are unique */
+    assert(add_dir_entry(ROOT_DIR_INUM, inumbers[1], "file0") == -1);
+
+    for (size_t i = 0; i < ENTRIES; i += CLEARED) {
+        assert(clear_dir_entry(ROOT_DIR_INUM, inumbers[i]) == 0);
+    }
+    assert(clear_dir_entry(ROOT_DIR_INUM, inumbers[0]) == -1);
+    for (size_t i = 0; i < ENTRIES; i++) {
+        name_of(path, i);
+        assert(find_in_dir(ROOT_DIR_INUM, path + 1) ==
+               (i % CLEARED == 0 ? -1 : inumbers[i]));
+    }
+
+    /* Freed entries are reused */
+    assert(add_dir_entry(ROOT_DIR_INUM, inumbers[0], "file0") == 0);
+    assert(find_in_dir(ROOT_DIR_INUM, "file0") == inumbers[0]);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
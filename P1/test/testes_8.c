@@ -0,0 +1,76 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <string.h>
+
+/*  Builds a small directory tree and opens, writes and reads files at
+    several depths, checking that names are resolved per directory and
+    that bad paths are rejected. */
+
+static void write_file(char const *path, char const *text) {
+    int f = tfs_open(path, TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, text, strlen(text)) == strlen(text));
+    assert(tfs_close(f) != -1);
+}
+
+static void check_file(char const *path, char const *text) {
+    char buffer[64];
+    int f = tfs_open(path, 0);
+    assert(f != -1);
+    ssize_t r = tfs_read(f, buffer, sizeof(buffer));
+    assert(r == strlen(text));
+    assert(memcmp(buffer, text, (size_t)r) == 0);
+    assert(tfs_close(f) != -1);
+}
+
+int main() {
+    assert(tfs_init() != -1);
+
+    assert(tfs_mkdir("/a") != -1);
+    assert(tfs_mkdir("/a/b") != -1);
+    assert(tfs_mkdir("/a/b/c") != -1);
+    assert(tfs_mkdir("/x") != -1);
+
+    /* The same name in different directories */
+    write_file("/f", "root");
+    write_file("/a/f", "a");
+    write_file("/a/b/c/f", "deep");
+    write_file("/x/f", "x");
+    check_file("/f", "root");
+    check_file("/a/f", "a");
+    check_file("/a/b/c/f", "deep");
+    check_file("/x/f", "x");
+    assert(tfs_lookup("/a/b/f") == -1);
+    assert(tfs_lookup("/a/b/c") != -1);
+    assert(tfs_lookup("/a/b/c/f") != tfs_lookup("/x/f"));
+
+    /* Taken names, missing parents, files used as directories */
+    assert(tfs_mkdir("/a/b") == -1);
+    assert(tfs_mkdir("/a/f") == -1);
+    assert(tfs_mkdir("/missing/d") == -1);
+    assert(tfs_mkdir("/a/f/d") == -1);
+    assert(tfs_open("/a/f/g", TFS_O_CREAT) == -1);
+    assert(tfs_open("/missing/g", TFS_O_CREAT) == -1);
+
+    /* Directories are not opened as files */
+    assert(tfs_open("/a/b", 0) == -1);
+    assert(tfs_open("/a", TFS_O_CREAT) == -1);
+
+    /* Malformed paths */
+    assert(tfs_lookup("/a//f") == -1);
+    assert(tfs_lookup("/a/") == -1);
+    assert(tfs_mkdir("/") == -1);
+    assert(tfs_mkdir("a") == -1);
+
+    /* A cleared entry is not served from the dentry cache */
+    int b = tfs_lookup("/a/b");
+    assert(clear_dir_entry(tfs_lookup("/a"), b) == 0);
+    assert(tfs_lookup("/a/b") == -1);
+    assert(tfs_lookup("/a/b/c/f") == -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
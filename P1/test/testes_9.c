@@ -0,0 +1,66 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <string.h>
+
+/*  Stores names of every length in a directory, checks that names that are
+    prefixes of one another are told apart and that names are cut to
+    MAX_FILE_NAME - 1 characters, then adds and clears entries many times
+    over, checking that the space of cleared names is reused without the
+    directory growing. */
+
+#define CHURN (1000)
+
+int main() {
+    char name[MAX_FILE_NAME + 8];
+
+    assert(tfs_init() != -1);
+    assert(tfs_mkdir("/d") != -1);
+    int d = tfs_lookup("/d");
+    assert(d != -1);
+
+    /* "a", "aa", ..., one name of each storable length */
+    for (int len = 1; len < MAX_FILE_NAME; len++) {
+        memset(name, 'a', (size_t)len);
+        name[len] = '\0';
+        assert(add_dir_entry(d, len, name) == 0);
+    }
+    for (int len = 1; len < MAX_FILE_NAME; len++) {
+        memset(name, 'a', (size_t)len);
+        name[len] = '\0';
+        assert(find_in_dir(d, name) == len);
+    }
+
+    /* Longer names are cut when added, and never found */
+    memset(name, 'b', MAX_FILE_NAME + 4);
+    name[MAX_FILE_NAME + 4] = '\0';
+    assert(add_dir_entry(d, 45, name) == 0);
+    assert(find_in_dir(d, name) == -1);
+    name[MAX_FILE_NAME - 1] = '\0';
+    assert(find_in_dir(d, name) == 45);
+    assert(add_dir_entry(d, 46, name) == -1);
+
+    assert(clear_dir_entry(d, 45) == 0);
+    assert(find_in_dir(d, "a") == 1);
+    assert(find_in_dir(d, "aaaaaaaaaa") == 10);
+
+    /* Adding and clearing reuses the space of the cleared names: the
+     * single bucket of a small directory is never split */
+    assert(tfs_mkdir("/e") != -1);
+    int e = tfs_lookup("/e");
+    assert(add_dir_entry(e, 48, "kept") == 0);
+    for (int i = 0; i < CHURN; i++) {
+        sprintf(name, "churn%d", i);
+        assert(add_dir_entry(e, 47, name) == 0);
+        assert(find_in_dir(e, name) == 47);
+        assert(clear_dir_entry(e, 47) == 0);
+        assert(find_in_dir(e, name) == -1);
+    }
+    assert(inode_get(e)->i_dir_buckets == 1);
+    assert(find_in_dir(e, "kept") == 48);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
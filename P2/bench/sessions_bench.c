@@ -0,0 +1,77 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*  Measures the throughput of TecnicoFS, used as a library, as the number
+    of concurrent sessions grows. Each session is a thread (as the server's
+    consumer threads are) that works on a file of its own: it opens it,
+    writes it, reads it back and closes it, ROUNDS times. */
+
+#define ROUNDS (200)
+#define FILE_BYTES (512)
+
+/* Numbers of sessions measured (the server runs up to 10) */
+static int const sessions[] = {1, 2, 4, 8, 10};
+#define SESSION_COUNTS (sizeof(sessions) / sizeof(sessions[0]))
+
+static void *session(void *arg) {
+    int id = *(int *)arg;
+    char path[MAX_FILE_NAME];
+    char data[FILE_BYTES], buffer[FILE_BYTES];
+
+    sprintf(path, "/session%d", id);
+    memset(data, 'a' + id % 26, sizeof(data));
+    for (int r = 0; r < ROUNDS; r++) {
+        int f = tfs_open(path, TFS_O_CREAT | TFS_O_TRUNC);
+        assert(f != -1);
+        assert(tfs_write(f, data, sizeof(data)) == sizeof(data));
+        assert(tfs_close(f) != -1);
+
+        f = tfs_open(path, 0);
+        assert(f != -1);
+        assert(tfs_read(f, buffer, sizeof(buffer)) == sizeof(buffer));
+        assert(memcmp(buffer, data, sizeof(data)) == 0);
+        assert(tfs_close(f) != -1);
+    }
+    return NULL;
+}
+
+static double elapsed_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) +
+           (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main() {
+    pthread_t threads[10];
+    int ids[10];
+    struct timespec start, end;
+
+    printf("%-9s %12s %9s\n", "sessions", "ops/s", "speedup");
+    double single = 0;
+    for (size_t c = 0; c < SESSION_COUNTS; c++) {
+        int n = sessions[c];
+        assert(tfs_init() != -1);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < n; i++) {
+            ids[i] = i;
+            assert(pthread_create(&threads[i], NULL, session, &ids[i]) == 0);
+        }
+        for (int i = 0; i < n; i++) {
+            assert(pthread_join(threads[i], NULL) == 0);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        assert(tfs_destroy() != -1);
+
+        /* Each round is six operations */
+        double ops = (double)n * ROUNDS * 6 / elapsed_s(&start, &end);
+        if (c == 0) {
+            single = ops;
+        }
+        printf("%-9d %12.0f %8.2fx\n", n, ops, ops / single);
+    }
+
+    return 0;
+}
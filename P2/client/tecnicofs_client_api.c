@@ -10,11 +10,52 @@
 
 #define MAX_SIZE_MESSAGE (100)
 #define MAX_PIPE_NAME (40)
+/* Bytes before the contents of a write request ('8' carries an offset) */
+#define WRITE_HEADER(op) (sizeof(char) + sizeof(int) + sizeof(int) + \
+                          ((op) == '8' ? sizeof(off_t) : 0) + sizeof(size_t))
 
 int session_id;
 int fclient, fserver;
 char pipe_buffer[MAX_PIPE_NAME];
 
+/* Sends a request (a whole message, in a single write, so that requests of
+ * different clients are not interleaved) to the server */
+static void send_request(char const *message_buffer) {
+    ssize_t msg;
+
+    do
+    {
+        msg = write(fserver, message_buffer, MAX_SIZE_MESSAGE);
+    } while (msg == -1 && errno == EINTR);
+
+    if (msg == -1)
+    {
+        fprintf(stderr, "[ERR]: client write on server pipe failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Receives len bytes of a reply from the server, which may arrive in
+ * several pieces (the server writes a result, then the bytes read) */
+static void receive_reply(void *buffer, size_t len) {
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t msg = read(fclient, (char *)buffer + done, len - done);
+        if (msg == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (msg <= 0)
+        {
+            fprintf(stderr, "[ERR]: client read failed: %s\n",
+                    msg == 0 ? "server closed the pipe" : strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        done += (size_t)msg;
+    }
+}
+
 int tfs_mount(char const *client_pipe_path, char const *server_pipe_path) {
     char message_buffer[MAX_SIZE_MESSAGE] = "";
     ssize_t msg;
@@ -104,6 +145,10 @@ int tfs_unmount() {
         exit(EXIT_FAILURE);
     }
 
+    /* The server answers before it closes its end of the client pipe */
+    int res;
+    receive_reply(&res, sizeof(int));
+
     if (close(fclient) < 0)
         return -1;
 
@@ -121,31 +166,11 @@ int tfs_open(char const *name, int flags) {
     char message_buffer[MAX_SIZE_MESSAGE] = "";
     memcpy(message_buffer, "3", sizeof(char));
     memcpy(message_buffer + sizeof(char), &session_id, sizeof(int));
-    memcpy(message_buffer + sizeof(char) + sizeof(int), name, MAX_PIPE_NAME*sizeof(char));
-    memcpy(message_buffer + sizeof(char) + sizeof(int) + sizeof(char), &flags, sizeof(int));
-    ssize_t msg;
-
-    do
-    {
-        msg = write(fserver, message_buffer, sizeof(message_buffer));
-    } while (msg == -1 && errno == EINTR);
-
-    if (msg == -1)
-    {
-        fprintf(stderr, "[ERR]: client write on server pipe failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
-    }
-
-    do
-    {
-        msg = read(fclient, &res, sizeof(int));
-    } while (msg == -1 && errno == EINTR);
+    strncpy(message_buffer + sizeof(char) + sizeof(int), name, MAX_PIPE_NAME - 1);
+    memcpy(message_buffer + sizeof(char) + sizeof(int) + MAX_PIPE_NAME*sizeof(char), &flags, sizeof(int));
 
-    if (msg == -1)
-    {
-        fprintf(stderr, "[ERR]: client read failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
-    }
+    send_request(message_buffer);
+    receive_reply(&res, sizeof(int));
 
     return res;
 }
@@ -156,101 +181,213 @@ int tfs_close(int fhandle) {
     memcpy(message_buffer, "4", sizeof(char));
     memcpy(message_buffer + sizeof(char), &session_id, sizeof(int));
     memcpy(message_buffer + sizeof(char) + sizeof(int), &fhandle, sizeof(int));
-    ssize_t msg;
 
-    do
-    {
-        msg = write(fserver, message_buffer, sizeof(message_buffer));
-    } while (msg == -1 && errno == EINTR);
+    send_request(message_buffer);
+    receive_reply(&res, sizeof(int));
 
-    if (msg == -1)
+    return res;
+}
+
+/* Sends a single write request ('5' at the handle's offset, '8' at a given
+ * offset) for len bytes, at most WRITE_CHUNK(op) of them
+ * Returns the server's result */
+static ssize_t write_request(char op, int fhandle, void const *buffer, size_t len, off_t offset) {
+    ssize_t res;
+    char message_buffer[MAX_SIZE_MESSAGE] = "";
+    size_t at = sizeof(char);
+    memcpy(message_buffer, &op, sizeof(char));
+    memcpy(message_buffer + at, &session_id, sizeof(int));
+    at += sizeof(int);
+    memcpy(message_buffer + at, &fhandle, sizeof(int));
+    at += sizeof(int);
+    if (op == '8')
     {
-        fprintf(stderr, "[ERR]: client write on server pipe failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        memcpy(message_buffer + at, &offset, sizeof(off_t));
+        at += sizeof(off_t);
     }
+    memcpy(message_buffer + at, &len, sizeof(size_t));
+    at += sizeof(size_t);
+    memcpy(message_buffer + at, buffer, len * sizeof(char));
 
-    do
-    {
-        msg = read(fclient, &res, sizeof(int));
-    } while (msg == -1 && errno == EINTR);
+    send_request(message_buffer);
+    receive_reply(&res, sizeof(ssize_t));
 
-    if (msg == -1)
+    return res;
+}
+
+/* Writes len bytes in as many requests as needed, stopping at the first
+ * one that is not written in full
+ * Returns the number of bytes written, or -1 if the first request failed */
+static ssize_t write_chunked(char op, int fhandle, void const *buffer, size_t len, off_t offset) {
+    size_t chunk = MAX_SIZE_MESSAGE - WRITE_HEADER(op);
+    size_t done = 0;
+    while (done < len)
     {
-        fprintf(stderr, "[ERR]: client read failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        size_t n = len - done < chunk ? len - done : chunk;
+        ssize_t res = write_request(op, fhandle, (char const *)buffer + done, n, offset + (off_t)done);
+        if (res == -1)
+        {
+            return done == 0 ? -1 : (ssize_t)done;
+        }
+        done += (size_t)res;
+        if ((size_t)res < n)
+        {
+            break;
+        }
     }
-
-    return res;
+    return (ssize_t)done;
 }
 
 ssize_t tfs_write(int fhandle, void const *buffer, size_t len) {
+    return write_chunked('5', fhandle, buffer, len, 0);
+}
+
+/* Sends a single read request ('6' at the handle's offset, '9' at a given
+ * offset) for len bytes
+ * Returns the server's result; the bytes read are left in the client pipe,
+ * to be received by the caller */
+static ssize_t read_request(char op, int fhandle, size_t len, off_t offset) {
     ssize_t res;
     char message_buffer[MAX_SIZE_MESSAGE] = "";
-    memcpy(message_buffer, "5", sizeof(char));
-    memcpy(message_buffer + sizeof(char), &session_id, sizeof(int));
-    memcpy(message_buffer + sizeof(char) + sizeof(int), &fhandle, sizeof(int));
-    memcpy(message_buffer + sizeof(char) + sizeof(int) + sizeof(int), &len, sizeof(size_t));
-    memcpy(message_buffer + sizeof(char) + sizeof(int) + sizeof(int) + sizeof(size_t), buffer, len * sizeof(char));
-    ssize_t msg;
-
-    do
+    size_t at = sizeof(char);
+    memcpy(message_buffer, &op, sizeof(char));
+    memcpy(message_buffer + at, &session_id, sizeof(int));
+    at += sizeof(int);
+    memcpy(message_buffer + at, &fhandle, sizeof(int));
+    at += sizeof(int);
+    if (op == '9')
     {
-        msg = write(fserver, message_buffer, sizeof(message_buffer));
-    } while (msg == -1 && errno == EINTR);
+        memcpy(message_buffer + at, &offset, sizeof(off_t));
+        at += sizeof(off_t);
+    }
+    memcpy(message_buffer + at, &len, sizeof(size_t));
 
-    if (msg == -1)
+    send_request(message_buffer);
+    receive_reply(&res, sizeof(ssize_t));
+
+    return res;
+}
+
+ssize_t tfs_read(int fhandle, void *buffer, size_t len) {
+    ssize_t res = read_request('6', fhandle, len, 0);
+    if (res > 0)
     {
-        fprintf(stderr, "[ERR]: client write on server pipe failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        receive_reply(buffer, (size_t)res);
     }
+    return res;
+}
 
-    do
+ssize_t tfs_pwrite(int fhandle, void const *buffer, size_t len, off_t offset) {
+    if (offset < 0)
     {
-        msg = read(fclient, &res, sizeof(ssize_t));
-    } while (msg == -1 && errno == EINTR);
+        return -1;
+    }
+    return write_chunked('8', fhandle, buffer, len, offset);
+}
 
-    if (msg == -1)
+ssize_t tfs_pread(int fhandle, void *buffer, size_t len, off_t offset) {
+    ssize_t res = read_request('9', fhandle, len, offset);
+    if (res > 0)
     {
-        fprintf(stderr, "[ERR]: client read failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        receive_reply(buffer, (size_t)res);
     }
-
     return res;
 }
 
-ssize_t tfs_read(int fhandle, void *buffer, size_t len) {
-    ssize_t res;
-    char message_buffer[MAX_SIZE_MESSAGE] = "";
-    char receiver_buffer[MAX_SIZE_MESSAGE] = ""; 
-    memcpy(message_buffer, "6", sizeof(char));
-    memcpy(message_buffer + sizeof(char), &session_id, sizeof(int));
-    memcpy(message_buffer + sizeof(char) + sizeof(int), &fhandle, sizeof(int));
-    ssize_t msg;
-
-    do
+ssize_t tfs_writev(int fhandle, struct iovec const *iov, int iovcnt) {
+    char gathered[MAX_SIZE_MESSAGE];
+    size_t chunk = MAX_SIZE_MESSAGE - WRITE_HEADER('5');
+    size_t done = 0, len = 0;
+    if (iovcnt < 0)
     {
-        msg = write(fserver, message_buffer, sizeof(message_buffer));
-    } while (msg == -1 && errno == EINTR);
-
-    if (msg == -1)
+        return -1;
+    }
+    /* GATHER THE BUFFERS INTO AS FEW WRITE REQUESTS AS POSSIBLE,
+     * STOPPING AT THE FIRST ONE THAT IS NOT WRITTEN IN FULL */
+    for (int i = 0; i <= iovcnt; i++)
     {
-        fprintf(stderr, "[ERR]: client write on server pipe failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        size_t used = 0;
+        while (i < iovcnt && used < iov[i].iov_len)
+        {
+            size_t n = iov[i].iov_len - used;
+            if (n > chunk - len)
+            {
+                n = chunk - len;
+            }
+            memcpy(gathered + len, (char const *)iov[i].iov_base + used, n);
+            len += n;
+            used += n;
+            if (len == chunk)
+            {
+                ssize_t res = write_request('5', fhandle, gathered, len, 0);
+                if (res == -1)
+                {
+                    return done == 0 ? -1 : (ssize_t)done;
+                }
+                done += (size_t)res;
+                if ((size_t)res < len)
+                {
+                    return (ssize_t)done;
+                }
+                len = 0;
+            }
+        }
+    }
+    if (len > 0)
+    {
+        ssize_t res = write_request('5', fhandle, gathered, len, 0);
+        if (res == -1)
+        {
+            return done == 0 ? -1 : (ssize_t)done;
+        }
+        done += (size_t)res;
     }
+    return (ssize_t)done;
+}
 
-    do
+ssize_t tfs_readv(int fhandle, struct iovec const *iov, int iovcnt) {
+    size_t len = 0;
+    if (iovcnt < 0)
     {
-        msg = read(fclient, receiver_buffer, sizeof(ssize_t) + len*sizeof(char));
-    } while (msg == -1 && errno == EINTR);
+        return -1;
+    }
+    /* A SINGLE READ REQUEST FOR ALL THE BUFFERS */
+    for (int i = 0; i < iovcnt; i++)
+    {
+        len += iov[i].iov_len;
+    }
+    ssize_t res = read_request('6', fhandle, len, 0);
+    /* SCATTER THE CONTENT OVER THE BUFFERS */
+    size_t done = 0;
+    for (int i = 0; i < iovcnt && res > 0 && done < (size_t)res; i++)
+    {
+        size_t n = iov[i].iov_len;
+        if (n > (size_t)res - done)
+        {
+            n = (size_t)res - done;
+        }
+        receive_reply(iov[i].iov_base, n);
+        done += n;
+    }
 
-    if (msg == -1)
+    return res;
+}
+
+int tfs_copy_from_external_fs(char const *source_path, char const *dest_path) {
+    int res;
+    char message_buffer[MAX_SIZE_MESSAGE] = "";
+    if (strlen(source_path) >= MAX_PIPE_NAME || strlen(dest_path) >= MAX_PIPE_NAME)
     {
-        fprintf(stderr, "[ERR]: client read failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        return -1;
     }
+    /* OP CODE 10 */
+    memcpy(message_buffer, ":", sizeof(char));
+    memcpy(message_buffer + sizeof(char), &session_id, sizeof(int));
+    strcpy(message_buffer + sizeof(char) + sizeof(int), source_path);
+    strcpy(message_buffer + sizeof(char) + sizeof(int) + MAX_PIPE_NAME, dest_path);
 
-    memcpy(&res, receiver_buffer, sizeof(ssize_t));
-    memcpy(buffer, receiver_buffer + sizeof(ssize_t), res * sizeof(char));
+    send_request(message_buffer);
+    receive_reply(&res, sizeof(int));
 
     return res;
 }
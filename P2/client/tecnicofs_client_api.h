@@ -3,6 +3,7 @@
 
 #include "common/common.h"
 #include <sys/types.h>
+#include <sys/uio.h>
 
 /*
  * Establishes a session with a TecnicoFS server.
@@ -72,6 +73,75 @@ ssize_t tfs_write(int fhandle, void const *buffer, size_t len);
  */
 ssize_t tfs_read(int fhandle, void *buffer, size_t len);
 
+/* Writes to an open file at a given offset, without using or moving the
+ * handle's offset
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- buffer containing the contents to write
+ * 	- length of the contents (in bytes)
+ * 	- offset in the file to write at
+ *
+ * Contents larger than a request are sent in several requests, so another
+ * client's write may land between them.
+ *
+ * Returns the number of bytes that were written (can be lower than
+ * 'len' if the maximum file size is exceeded), or -1 in case of error
+ * (including a negative offset).
+ */
+ssize_t tfs_pwrite(int fhandle, void const *buffer, size_t len, off_t offset);
+
+/* Reads from an open file at a given offset, without using or moving the
+ * handle's offset
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- destination buffer
+ * 	- length of the buffer
+ * 	- offset in the file to read from
+ *
+ * Returns the number of bytes that were copied from the file to the buffer
+ * (can be lower than 'len' if the file size was reached), or -1 in case of
+ * error (including a negative offset).
+ */
+ssize_t tfs_pread(int fhandle, void *buffer, size_t len, off_t offset);
+
+/* Writes the contents of several buffers, one after the other, to an open
+ * file, starting at the current offset, gathered in as few requests as
+ * possible
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- array of buffers (base and length of each one)
+ * 	- number of buffers
+ *
+ * As in tfs_pwrite(), contents larger than a request are not written
+ * atomically.
+ *
+ * Returns as tfs_write(), and -1 if the number of buffers is negative.
+ */
+ssize_t tfs_writev(int fhandle, struct iovec const *iov, int iovcnt);
+
+/* Reads from an open file, starting at the current offset, into several
+ * buffers, filling each one before the next, with a single request
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- array of buffers (base and length of each one)
+ * 	- number of buffers
+ *
+ * Returns as tfs_read(), and -1 if the number of buffers is negative.
+ */
+ssize_t tfs_readv(int fhandle, struct iovec const *iov, int iovcnt);
+
+/* Orders TecnicoFS server to copy a file of the OS' file system tree
+ * (outside TecnicoFS) to a file in TecnicoFS, in a single request
+ * Input:
+ * 	- path name of the source file (in the server's file system; at most
+ * 	  39 characters), a regular file of at most BLOCK_SIZE bytes
+ * 	- path name of the destination file (in TecnicoFS), which is created
+ * 	  if needed, and truncated if it already exists
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_copy_from_external_fs(char const *source_path, char const *dest_path);
+
 /*
  * Orders TecnicoFS server to wait until no file is open and then shutdown
  * Returns 0 if successful, -1 otherwise.
@@ -16,7 +16,10 @@ enum {
     TFS_OP_CODE_CLOSE = 4,
     TFS_OP_CODE_WRITE = 5,
     TFS_OP_CODE_READ = 6,
-    TFS_OP_CODE_SHUTDOWN_AFTER_ALL_CLOSED = 7
+    TFS_OP_CODE_SHUTDOWN_AFTER_ALL_CLOSED = 7,
+    TFS_OP_CODE_PWRITE = 8,
+    TFS_OP_CODE_PREAD = 9,
+    TFS_OP_CODE_COPY_FROM_EXTERNAL_FS = 10
 };
 
 #endif /* COMMON_H */
\ No newline at end of file
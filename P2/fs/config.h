@@ -9,6 +9,8 @@
 #define INODE_TABLE_SIZE (50)
 #define MAX_OPEN_FILES (20)
 #define MAX_FILE_NAME (40)
+/* Hash chains of a directory's entries (a power of two) */
+#define DIR_BUCKETS (16)
 
 #define DELAY (5000)
 
@@ -1,18 +1,22 @@
 #include "operations.h"
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-static pthread_mutex_t single_global_lock;
+static pthread_mutex_t close_mutex; /* trinco para esperar que os ficheiros fechem */
 static pthread_cond_t cond;
 static int state;
 
 int tfs_init() {
     state_init();
 
-    if (pthread_mutex_init(&single_global_lock, 0) != 0)
+    if (pthread_mutex_init(&close_mutex, 0) != 0)
         return -1;
 
     if (pthread_cond_init(&cond, NULL) != 0)
@@ -30,7 +34,7 @@ int tfs_init() {
 
 int tfs_destroy() {
     state_destroy();
-    if (pthread_mutex_destroy(&single_global_lock) != 0) {
+    if (pthread_mutex_destroy(&close_mutex) != 0) {
         return -1;
     }
 
@@ -45,19 +49,20 @@ static bool valid_pathname(char const *name) {
 
 int tfs_destroy_after_all_closed() {
     state = CLOSING;
-    if (pthread_mutex_lock(&single_global_lock) != 0)
+    if (pthread_mutex_lock(&close_mutex) != 0)
         return -1;
-    if (open_file_count != 0) {
-        if (pthread_cond_wait(&cond, &single_global_lock) != 0)
+    /* tfs_close() signals once it closes the last file */
+    while (open_file_table_count() != 0) {
+        if (pthread_cond_wait(&cond, &close_mutex) != 0)
             return -1;
     }
-    if (pthread_mutex_unlock(&single_global_lock) != 0)
+    if (pthread_mutex_unlock(&close_mutex) != 0)
         return -1;
     tfs_destroy();
     return 0;
 }
 
-int _tfs_lookup_unsynchronized(char const *name) {
+int tfs_lookup(char const *name) {
     if (!valid_pathname(name)) {
         return -1;
     }
@@ -65,46 +70,22 @@ int _tfs_lookup_unsynchronized(char const *name) {
     // skip the initial '/' character
     name++;
 
+    /* The directory is read under its own lock */
     return find_in_dir(ROOT_DIR_INUM, name);
 }
 
-int tfs_lookup(char const *name) {
-    if (pthread_mutex_lock(&single_global_lock) != 0)
-        return -1;
-    int ret = _tfs_lookup_unsynchronized(name);
-    if (pthread_mutex_unlock(&single_global_lock) != 0)
-        return -1;
-    return ret;
-}
-
-static int _tfs_open_unsynchronized(char const *name, int flags) {
+int tfs_open(char const *name, int flags) {
     int inum;
     size_t offset;
 
-    inum = _tfs_lookup_unsynchronized(name);
-    if (inum >= 0) {
-        /* The file already exists */
-        inode_t *inode = inode_get(inum);
-        if (inode == NULL) {
-            return -1;
-        }
+    if (state == CLOSING || !valid_pathname(name))
+        return -1;
 
-        /* Trucate (if requested) */
-        if (flags & TFS_O_TRUNC) {
-            if (inode->i_size > 0) {
-                if (data_block_free(inode->i_data_block) == -1) {
-                    return -1;
-                }
-                inode->i_size = 0;
-            }
-        }
-        /* Determine initial offset */
-        if (flags & TFS_O_APPEND) {
-            offset = inode->i_size;
-        } else {
-            offset = 0;
+    inum = tfs_lookup(name);
+    if (inum < 0) {
+        if (!(flags & TFS_O_CREAT)) {
+            return -1;
         }
-    } else if (flags & TFS_O_CREAT) {
         /* The file doesn't exist; the flags specify that it should be created*/
         /* Create inode */
         inum = inode_create(T_FILE);
@@ -112,15 +93,43 @@ static int _tfs_open_unsynchronized(char const *name, int flags) {
             return -1;
         }
         /* Add entry in the root directory */
-        if (add_dir_entry(ROOT_DIR_INUM, inum, name + 1) == -1) {
-            inode_delete(inum);
+        if (add_dir_entry(ROOT_DIR_INUM, inum, name + 1) != -1) {
+            return add_to_open_file_table(inum, 0);
+        }
+        inode_delete(inum);
+        /* Another session may have created the file in the meantime */
+        inum = tfs_lookup(name);
+        if (inum < 0) {
             return -1;
         }
-        offset = 0;
-    } else {
+    }
+
+    /* The file already exists */
+    inode_t *inode = inode_get(inum);
+    if (inode == NULL) {
         return -1;
     }
 
+    /* Bloqueia o trinco read write do inode em write. */
+    pthread_rwlock_wrlock(&inode->i_lock);
+    /* Trucate (if requested) */
+    if ((flags & TFS_O_TRUNC) && inode->i_size > 0) {
+        if (data_block_free(inode->i_data_block) == -1) {
+            /* Desloqueia o trinco read write do inode. */
+            pthread_rwlock_unlock(&inode->i_lock);
+            return -1;
+        }
+        inode->i_size = 0;
+    }
+    /* Determine initial offset */
+    if (flags & TFS_O_APPEND) {
+        offset = inode->i_size;
+    } else {
+        offset = 0;
+    }
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
+
     /* Finally, add entry to the open file table and
      * return the corresponding handle */
     return add_to_open_file_table(inum, offset);
@@ -130,47 +139,31 @@ static int _tfs_open_unsynchronized(char const *name, int flags) {
      * opened but it remains created */
 }
 
-int tfs_open(char const *name, int flags) {
-    if (state == CLOSING)
-        return -1;
-    if (pthread_mutex_lock(&single_global_lock) != 0)
-        return -1;
-    int ret = _tfs_open_unsynchronized(name, flags);
-    if (pthread_mutex_unlock(&single_global_lock) != 0)
-        return -1;
-
-    return ret;
-}
-
 int tfs_close(int fhandle) {
-    if (pthread_mutex_lock(&single_global_lock) != 0)
-        return -1;
     int r = remove_from_open_file_table(fhandle);
-    if (open_file_count == 0) {
-        if (pthread_cond_signal(&cond) != 0)
+    if (r == 0) {
+        if (pthread_mutex_lock(&close_mutex) != 0)
+            return -1;
+        if (open_file_table_count() == 0) {
+            if (pthread_cond_signal(&cond) != 0)
+                return -1;
+        }
+        if (pthread_mutex_unlock(&close_mutex) != 0)
             return -1;
     }
-    if (pthread_mutex_unlock(&single_global_lock) != 0)
-        return -1;
     return r;
 }
 
-static ssize_t _tfs_write_unsynchronized(int fhandle, void const *buffer,
-                                         size_t to_write) {
-    open_file_entry_t *file = get_open_file_entry(fhandle);
-    if (file == NULL) {
-        return -1;
-    }
-
-    /* From the open file table entry, we get the inode */
-    inode_t *inode = inode_get(file->of_inumber);
-    if (inode == NULL) {
-        return -1;
-    }
-
+/* Writes to a file at a position, with the i-node's lock held in write
+ * Returns the number of bytes written, or -1 in case of error */
+static ssize_t write_at(inode_t *inode, void const *buffer, size_t to_write,
+                        size_t position) {
     /* Determine how many bytes to write */
-    if (to_write + file->of_offset > BLOCK_SIZE) {
-        to_write = BLOCK_SIZE - file->of_offset;
+    if (position >= BLOCK_SIZE) {
+        return 0;
+    }
+    if (to_write + position > BLOCK_SIZE) {
+        to_write = BLOCK_SIZE - position;
     }
 
     if (to_write > 0) {
@@ -183,32 +176,77 @@ static ssize_t _tfs_write_unsynchronized(int fhandle, void const *buffer,
         if (block == NULL) {
             return -1;
         }
-
+        /* A write past the end leaves zeros in between, not what the block
+         * held before */
+        if (position > inode->i_size) {
+            memset(block + inode->i_size, 0, position - inode->i_size);
+        }
         /* Perform the actual write */
-        memcpy(block + file->of_offset, buffer, to_write);
+        memcpy(block + position, buffer, to_write);
 
-        /* The offset associated with the file handle is
-         * incremented accordingly */
-        file->of_offset += to_write;
-        if (file->of_offset > inode->i_size) {
-            inode->i_size = file->of_offset;
+        if (position + to_write > inode->i_size) {
+            inode->i_size = position + to_write;
         }
     }
-
     return (ssize_t)to_write;
 }
 
+/* Reads from a file at a position, with the i-node's lock held in read
+ * Returns the number of bytes read, or -1 in case of error */
+static ssize_t read_at(inode_t *inode, void *buffer, size_t len,
+                       size_t position) {
+    /* Determine how many bytes to read */
+    size_t to_read = 0;
+    if (inode->i_size > position) {
+        to_read = inode->i_size - position;
+    }
+    if (to_read > len) {
+        to_read = len;
+    }
+
+    if (to_read > 0) {
+        void *block = data_block_get(inode->i_data_block);
+        if (block == NULL) {
+            return -1;
+        }
+        /* Perform the actual read */
+        memcpy(buffer, block + position, to_read);
+    }
+    return (ssize_t)to_read;
+}
+
 ssize_t tfs_write(int fhandle, void const *buffer, size_t to_write) {
-    if (pthread_mutex_lock(&single_global_lock) != 0)
+    open_file_entry_t *file = get_open_file_entry(fhandle);
+    if (file == NULL) {
         return -1;
-    ssize_t ret = _tfs_write_unsynchronized(fhandle, buffer, to_write);
-    if (pthread_mutex_unlock(&single_global_lock) != 0)
+    }
+
+    /* From the open file table entry, we get the inode */
+    inode_t *inode = inode_get(file->of_inumber);
+    if (inode == NULL) {
         return -1;
+    }
+
+    /* Bloqueia o trinco da open file entry. */
+    pthread_mutex_lock(&file->of_mutex);
+    /* Bloqueia o trinco read write do inode em write. */
+    pthread_rwlock_wrlock(&inode->i_lock);
+
+    ssize_t result = write_at(inode, buffer, to_write, file->of_offset);
+    if (result > 0) {
+        /* The offset associated with the file handle is
+         * incremented accordingly */
+        file->of_offset += (size_t)result;
+    }
 
-    return ret;
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
+    /* Desloqueia o trinco da open file entry. */
+    pthread_mutex_unlock(&file->of_mutex);
+    return result;
 }
 
-static ssize_t _tfs_read_unsynchronized(int fhandle, void *buffer, size_t len) {
+ssize_t tfs_read(int fhandle, void *buffer, size_t len) {
     open_file_entry_t *file = get_open_file_entry(fhandle);
     if (file == NULL) {
         return -1;
@@ -220,34 +258,104 @@ static ssize_t _tfs_read_unsynchronized(int fhandle, void *buffer, size_t len) {
         return -1;
     }
 
-    /* Determine how many bytes to read */
-    size_t to_read = inode->i_size - file->of_offset;
-    if (to_read > len) {
-        to_read = len;
-    }
-
-    if (to_read > 0) {
-        void *block = data_block_get(inode->i_data_block);
-        if (block == NULL) {
-            return -1;
-        }
+    /* Bloqueia o trinco da open file entry. */
+    pthread_mutex_lock(&file->of_mutex);
+    /* Bloqueia o trinco read write do inode em read. */
+    pthread_rwlock_rdlock(&inode->i_lock);
 
-        /* Perform the actual read */
-        memcpy(buffer, block + file->of_offset, to_read);
+    ssize_t result = read_at(inode, buffer, len, file->of_offset);
+    if (result > 0) {
         /* The offset associated with the file handle is
          * incremented accordingly */
-        file->of_offset += to_read;
+        file->of_offset += (size_t)result;
     }
 
-    return (ssize_t)to_read;
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
+    /* Desloqueia o trinco da open file entry. */
+    pthread_mutex_unlock(&file->of_mutex);
+    return result;
 }
 
-ssize_t tfs_read(int fhandle, void *buffer, size_t len) {
-    if (pthread_mutex_lock(&single_global_lock) != 0)
+ssize_t tfs_pwrite(int fhandle, void const *buffer, size_t len, off_t offset) {
+    open_file_entry_t *file = get_open_file_entry(fhandle);
+    if (file == NULL || offset < 0) {
+        return -1;
+    }
+
+    inode_t *inode = inode_get(file->of_inumber);
+    if (inode == NULL) {
+        return -1;
+    }
+
+    /* The handle's offset is neither used nor moved, so its lock is not
+     * taken */
+    /* Bloqueia o trinco read write do inode em write. */
+    pthread_rwlock_wrlock(&inode->i_lock);
+    ssize_t result = write_at(inode, buffer, len, (size_t)offset);
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
+    return result;
+}
+
+ssize_t tfs_pread(int fhandle, void *buffer, size_t len, off_t offset) {
+    open_file_entry_t *file = get_open_file_entry(fhandle);
+    if (file == NULL || offset < 0) {
+        return -1;
+    }
+
+    inode_t *inode = inode_get(file->of_inumber);
+    if (inode == NULL) {
+        return -1;
+    }
+
+    /* Bloqueia o trinco read write do inode em read. */
+    pthread_rwlock_rdlock(&inode->i_lock);
+    ssize_t result = read_at(inode, buffer, len, (size_t)offset);
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
+    return result;
+}
+
+int tfs_copy_from_external_fs(char const *source_path, char const *dest_path) {
+    int source = open(source_path, O_RDONLY);
+    if (source == -1) {
         return -1;
-    ssize_t ret = _tfs_read_unsynchronized(fhandle, buffer, len);
-    if (pthread_mutex_unlock(&single_global_lock) != 0)
+    }
+    struct stat st;
+    if (fstat(source, &st) == -1 || !S_ISREG(st.st_mode) ||
+        st.st_size > BLOCK_SIZE) {
+        close(source);
         return -1;
+    }
+    size_t size = (size_t)st.st_size;
+
+    /* The source is read straight from its pages, without a staging
+     * buffer (an empty file cannot be mapped) */
+    void *contents = NULL;
+    if (size > 0) {
+        contents = mmap(NULL, size, PROT_READ, MAP_PRIVATE, source, 0);
+        if (contents == MAP_FAILED) {
+            close(source);
+            return -1;
+        }
+    }
+
+    /* A single write, under a single lock of the destination */
+    int result = -1;
+    int dest = tfs_open(dest_path, TFS_O_CREAT | TFS_O_TRUNC);
+    if (dest != -1) {
+        if (size == 0 || tfs_write(dest, contents, size) == (ssize_t)size) {
+            result = 0;
+        }
+        if (tfs_close(dest) == -1) {
+            result = -1;
+        }
+    }
 
-    return ret;
+    if (size > 0) {
+        munmap(contents, size);
+    }
+    close(source);
+    return result;
 }
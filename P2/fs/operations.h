@@ -74,6 +74,29 @@ ssize_t tfs_write(int fhandle, void const *buffer, size_t len);
  */
 ssize_t tfs_read(int fhandle, void *buffer, size_t len);
 
+/* Writes to an open file at a given offset, without using or moving the
+ * handle's offset (so that sessions sharing a handle can write different
+ * parts of the file)
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- buffer containing the contents to write
+ * 	- length of the contents (in bytes)
+ * 	- offset in the file to write at
+ * Returns as tfs_write(), and -1 if the offset is negative
+ */
+ssize_t tfs_pwrite(int fhandle, void const *buffer, size_t len, off_t offset);
+
+/* Reads from an open file at a given offset, without using or moving the
+ * handle's offset
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- destination buffer
+ * 	- length of the buffer
+ * 	- offset in the file to read from
+ * Returns as tfs_read(), and -1 if the offset is negative
+ */
+ssize_t tfs_pread(int fhandle, void *buffer, size_t len, off_t offset);
+
 /* Copies the contents of a file that exists in TecnicoFS to the contents
  * of another file in the OS' file system tree (outside TecnicoFS).
  * Input:
@@ -84,4 +107,15 @@ ssize_t tfs_read(int fhandle, void *buffer, size_t len);
  */
 int tfs_copy_to_external_fs(char const *source_path, char const *dest_path);
 
+/* Copies the contents of a file in the OS' file system tree (outside
+ * TecnicoFS) to the contents of a file in TecnicoFS, in a single write.
+ * Input:
+ *      - path name of the source file (in the main file system), which
+ *        must be a regular file of at most BLOCK_SIZE bytes
+ *      - path name of the destination file (in TecnicoFS), which is
+ *        created if needed, and truncated if it already exists
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_copy_from_external_fs(char const *source_path, char const *dest_path);
+
 #endif // OPERATIONS_H
@@ -1,10 +1,12 @@
 #include "state.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 
 /* Persistent FS state  (in reality, it should be maintained in secondary
  * memory; for simplicity, this project maintains it in primary memory) */
@@ -12,15 +14,19 @@
 /* I-node table */
 static inode_t inode_table[INODE_TABLE_SIZE];
 static char freeinode_ts[INODE_TABLE_SIZE];
+static pthread_mutex_t it_mutex; /* trinco mutex para i-node table */
 
 /* Data blocks */
 static char fs_data[BLOCK_SIZE * DATA_BLOCKS];
 static char free_blocks[DATA_BLOCKS];
+static pthread_mutex_t db_mutex; /* trinco mutex para data blocks */
 
 /* Volatile FS state */
 
 static open_file_entry_t open_file_table[MAX_OPEN_FILES];
 static char free_open_file_entries[MAX_OPEN_FILES];
+static int open_file_count;
+static pthread_mutex_t vs_mutex; /* trinco mutex para volatile state */
 
 static inline bool valid_inumber(int inumber) {
     return inumber >= 0 && inumber < INODE_TABLE_SIZE;
@@ -67,6 +73,7 @@ static void insert_delay() {
 void state_init() {
     for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
         freeinode_ts[i] = FREE;
+        pthread_rwlock_init(&inode_table[i].i_lock, NULL);
     }
 
     for (size_t i = 0; i < DATA_BLOCKS; i++) {
@@ -75,12 +82,37 @@ void state_init() {
 
     for (size_t i = 0; i < MAX_OPEN_FILES; i++) {
         free_open_file_entries[i] = FREE;
+        pthread_mutex_init(&open_file_table[i].of_mutex, NULL);
     }
 
     open_file_count = 0;
+
+    /* Inicializa todos os trincos em state.c */
+    pthread_mutex_init(&it_mutex, NULL);
+    pthread_mutex_init(&db_mutex, NULL);
+    pthread_mutex_init(&vs_mutex, NULL);
+}
+
+void state_destroy() {
+    /* Destrói todos os trincos */
+    for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
+        pthread_rwlock_destroy(&inode_table[i].i_lock);
+    }
+    for (size_t i = 0; i < MAX_OPEN_FILES; i++) {
+        pthread_mutex_destroy(&open_file_table[i].of_mutex);
+    }
+    pthread_mutex_destroy(&it_mutex);
+    pthread_mutex_destroy(&db_mutex);
+    pthread_mutex_destroy(&vs_mutex);
 }
 
-void state_destroy() { /* nothing to do */
+/* Gives an i-node back to the i-node table */
+static void inode_release(int inumber) {
+    /* Bloqueia o trinco da tabela de inodes. */
+    pthread_mutex_lock(&it_mutex);
+    freeinode_ts[inumber] = FREE;
+    /* Desbloqueia o trinco da tabela de inodes. */
+    pthread_mutex_unlock(&it_mutex);
 }
 
 /*
@@ -96,10 +128,14 @@ int inode_create(inode_type n_type) {
             insert_delay(); // simulate storage access delay (to freeinode_ts)
         }
 
+        /* Bloqueia o trinco da tabela de inodes. */
+        pthread_mutex_lock(&it_mutex);
         /* Finds first free entry in i-node table */
         if (freeinode_ts[inumber] == FREE) {
             /* Found a free entry, so takes it for the new i-node*/
             freeinode_ts[inumber] = TAKEN;
+            /* Desbloqueia o trinco da tabela de inodes. */
+            pthread_mutex_unlock(&it_mutex);
             insert_delay(); // simulate storage access delay (to i-node)
             inode_table[inumber].i_node_type = n_type;
 
@@ -108,7 +144,7 @@ int inode_create(inode_type n_type) {
                  * entries, labeled with inumber==-1) */
                 int b = data_block_alloc();
                 if (b == -1) {
-                    freeinode_ts[inumber] = FREE;
+                    inode_release(inumber);
                     return -1;
                 }
 
@@ -117,13 +153,17 @@ int inode_create(inode_type n_type) {
 
                 dir_entry_t *dir_entry = (dir_entry_t *)data_block_get(b);
                 if (dir_entry == NULL) {
-                    freeinode_ts[inumber] = FREE;
+                    data_block_free(b);
+                    inode_release(inumber);
                     return -1;
                 }
 
                 for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
                     dir_entry[i].d_inumber = -1;
                 }
+                for (int i = 0; i < DIR_BUCKETS; i++) {
+                    inode_table[inumber].i_dir_buckets[i] = -1;
+                }
             } else {
                 /* In case of a new file, simply sets its size to 0 */
                 inode_table[inumber].i_size = 0;
@@ -131,6 +171,8 @@ int inode_create(inode_type n_type) {
             }
             return inumber;
         }
+        /* Desbloqueia o trinco da tabela de inodes. */
+        pthread_mutex_unlock(&it_mutex);
     }
     return -1;
 }
@@ -146,17 +188,31 @@ int inode_delete(int inumber) {
     insert_delay();
     insert_delay();
 
-    if (!valid_inumber(inumber) || freeinode_ts[inumber] == FREE) {
+    if (!valid_inumber(inumber)) {
         return -1;
     }
 
-    freeinode_ts[inumber] = FREE;
-
+    /* Bloqueia o trinco da tabela de inodes. */
+    pthread_mutex_lock(&it_mutex);
+    if (freeinode_ts[inumber] == FREE) {
+        /* Desbloqueia o trinco da tabela de inodes. */
+        pthread_mutex_unlock(&it_mutex);
+        return -1;
+    }
+    /* The data block is freed before the i-node, which inode_create() may
+     * then hand out (and reset) at once */
     if (inode_table[inumber].i_size > 0) {
         if (data_block_free(inode_table[inumber].i_data_block) == -1) {
+            /* Desbloqueia o trinco da tabela de inodes. */
+            pthread_mutex_unlock(&it_mutex);
             return -1;
         }
     }
+    inode_table[inumber].i_size = 0;
+    inode_table[inumber].i_data_block = -1;
+    freeinode_ts[inumber] = FREE;
+    /* Desbloqueia o trinco da tabela de inodes. */
+    pthread_mutex_unlock(&it_mutex);
 
     return 0;
 }
@@ -176,6 +232,21 @@ inode_t *inode_get(int inumber) {
     return &inode_table[inumber];
 }
 
+/*
+ * Returns the fingerprint of a directory entry name: a hash of (at most
+ * MAX_FILE_NAME - 1 characters of) the name, folded to 16 bits. Its low bits
+ * pick the hash chain of the entry.
+ */
+static uint16_t name_fingerprint(char const *name) {
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < MAX_FILE_NAME - 1 && name[i] != '\0'; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return (uint16_t)(hash ^ (hash >> 16));
+}
+
 /*
  * Adds an entry to the i-node directory data.
  * Input:
@@ -198,24 +269,100 @@ int add_dir_entry(int inumber, int sub_inumber, char const *sub_name) {
         return -1;
     }
 
+    inode_t *inode = &inode_table[inumber];
+    /* Bloqueia o trinco read write do inode em write. */
+    pthread_rwlock_wrlock(&inode->i_lock);
     /* Locates the block containing the directory's entries */
-    dir_entry_t *dir_entry =
-        (dir_entry_t *)data_block_get(inode_table[inumber].i_data_block);
+    dir_entry_t *dir_entry = (dir_entry_t *)data_block_get(inode->i_data_block);
     if (dir_entry == NULL) {
+        /* Desloqueia o trinco read write do inode. */
+        pthread_rwlock_unlock(&inode->i_lock);
         return -1;
     }
 
-    /* Finds and fills the first empty entry */
+    /* Names are unique within a directory: of two sessions creating the
+     * same file, only the first one adds it */
+    uint16_t fingerprint = name_fingerprint(sub_name);
+    int *bucket = &inode->i_dir_buckets[fingerprint % DIR_BUCKETS];
+    for (int i = *bucket; i != -1; i = dir_entry[i].d_next) {
+        if (dir_entry[i].d_hash == fingerprint &&
+            strncmp(dir_entry[i].d_name, sub_name, MAX_FILE_NAME - 1) == 0) {
+            /* Desloqueia o trinco read write do inode. */
+            pthread_rwlock_unlock(&inode->i_lock);
+            return -1;
+        }
+    }
+
+    /* Finds and fills the first empty entry, and links it at the head of
+     * its hash chain */
+    int result = -1;
     for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
         if (dir_entry[i].d_inumber == -1) {
             dir_entry[i].d_inumber = sub_inumber;
             strncpy(dir_entry[i].d_name, sub_name, MAX_FILE_NAME - 1);
             dir_entry[i].d_name[MAX_FILE_NAME - 1] = 0;
-            return 0;
+            dir_entry[i].d_hash = fingerprint;
+            dir_entry[i].d_next = (int16_t)*bucket;
+            *bucket = (int)i;
+            result = 0;
+            break;
         }
     }
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
+    return result;
+}
 
-    return -1;
+/*
+ * Removes the entry of a sub i-node from the i-node directory data.
+ * Input:
+ *  - inumber: identifier of the i-node
+ *  - sub_inumber: identifier of the sub i-node entry
+ * Returns: SUCCESS or FAIL
+ */
+int clear_dir_entry(int inumber, int sub_inumber) {
+    if (!valid_inumber(inumber) || !valid_inumber(sub_inumber)) {
+        return -1;
+    }
+
+    insert_delay(); // simulate storage access delay to i-node with inumber
+    if (inode_table[inumber].i_node_type != T_DIRECTORY) {
+        return -1;
+    }
+
+    inode_t *inode = &inode_table[inumber];
+    /* Bloqueia o trinco read write do inode em write. */
+    pthread_rwlock_wrlock(&inode->i_lock);
+    /* Locates the block containing the directory's entries */
+    dir_entry_t *dir_entry = (dir_entry_t *)data_block_get(inode->i_data_block);
+    if (dir_entry == NULL) {
+        /* Desloqueia o trinco read write do inode. */
+        pthread_rwlock_unlock(&inode->i_lock);
+        return -1;
+    }
+
+    int result = -1;
+    for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
+        if (dir_entry[i].d_inumber == sub_inumber) {
+            /* Unlinks the entry from its hash chain */
+            int *head = &inode->i_dir_buckets[dir_entry[i].d_hash % DIR_BUCKETS];
+            if (*head == (int)i) {
+                *head = dir_entry[i].d_next;
+            } else {
+                int prev = *head;
+                while (dir_entry[prev].d_next != (int)i) {
+                    prev = dir_entry[prev].d_next;
+                }
+                dir_entry[prev].d_next = dir_entry[i].d_next;
+            }
+            dir_entry[i].d_inumber = -1;
+            result = 0;
+            break;
+        }
+    }
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
+    return result;
 }
 
 /* Looks for a given name inside a directory
@@ -231,22 +378,33 @@ int find_in_dir(int inumber, char const *sub_name) {
         return -1;
     }
 
+    inode_t *inode = &inode_table[inumber];
+    /* Bloqueia o trinco read write do inode em read. */
+    pthread_rwlock_rdlock(&inode->i_lock);
     /* Locates the block containing the directory's entries */
-    dir_entry_t *dir_entry =
-        (dir_entry_t *)data_block_get(inode_table[inumber].i_data_block);
+    dir_entry_t *dir_entry = (dir_entry_t *)data_block_get(inode->i_data_block);
     if (dir_entry == NULL) {
+        /* Desloqueia o trinco read write do inode. */
+        pthread_rwlock_unlock(&inode->i_lock);
         return -1;
     }
 
-    /* Iterates over the directory entries looking for one that has the target
-     * name */
-    for (int i = 0; i < MAX_DIR_ENTRIES; i++)
-        if ((dir_entry[i].d_inumber != -1) &&
-            (strncmp(dir_entry[i].d_name, sub_name, MAX_FILE_NAME) == 0)) {
-            return dir_entry[i].d_inumber;
+    /* Only follows the hash chain of the name, and only compares the names
+     * of the entries whose fingerprint matches */
+    uint16_t fingerprint = name_fingerprint(sub_name);
+    int sub_inumber = -1;
+    for (int i = inode->i_dir_buckets[fingerprint % DIR_BUCKETS]; i != -1;
+         i = dir_entry[i].d_next) {
+        if (dir_entry[i].d_hash == fingerprint &&
+            strncmp(dir_entry[i].d_name, sub_name, MAX_FILE_NAME) == 0) {
+            sub_inumber = dir_entry[i].d_inumber;
+            break;
         }
+    }
+    /* Desloqueia o trinco read write do inode. */
+    pthread_rwlock_unlock(&inode->i_lock);
 
-    return -1;
+    return sub_inumber;
 }
 
 /*
@@ -259,10 +417,16 @@ int data_block_alloc() {
             insert_delay(); // simulate storage access delay to free_blocks
         }
 
+        /* Bloqueia trinco da tabela de data blocks. */
+        pthread_mutex_lock(&db_mutex);
         if (free_blocks[i] == FREE) {
             free_blocks[i] = TAKEN;
+            /* Desbloqueia trinco da tabela de data blocks. */
+            pthread_mutex_unlock(&db_mutex);
             return i;
         }
+        /* Desbloqueia trinco da tabela de data blocks. */
+        pthread_mutex_unlock(&db_mutex);
     }
     return -1;
 }
@@ -278,7 +442,11 @@ int data_block_free(int block_number) {
     }
 
     insert_delay(); // simulate storage access delay to free_blocks
+    /* Bloqueia trinco da tabela de data blocks. */
+    pthread_mutex_lock(&db_mutex);
     free_blocks[block_number] = FREE;
+    /* Desbloqueia trinco da tabela de data blocks. */
+    pthread_mutex_unlock(&db_mutex);
     return 0;
 }
 
@@ -303,15 +471,21 @@ void *data_block_get(int block_number) {
  * Returns: file handle if successful, -1 otherwise
  */
 int add_to_open_file_table(int inumber, size_t offset) {
+    /* Bloqueia o trinco da tabela de ficheiros abertos. */
+    pthread_mutex_lock(&vs_mutex);
     for (int i = 0; i < MAX_OPEN_FILES; i++) {
         if (free_open_file_entries[i] == FREE) {
             free_open_file_entries[i] = TAKEN;
             open_file_table[i].of_inumber = inumber;
             open_file_table[i].of_offset = offset;
             open_file_count++;
+            /* Desbloqueia o trinco da tabela de ficheiros abertos. */
+            pthread_mutex_unlock(&vs_mutex);
             return i;
         }
     }
+    /* Desbloqueia o trinco da tabela de ficheiros abertos. */
+    pthread_mutex_unlock(&vs_mutex);
     return -1;
 }
 
@@ -321,12 +495,20 @@ int add_to_open_file_table(int inumber, size_t offset) {
  * Returns 0 is success, -1 otherwise
  */
 int remove_from_open_file_table(int fhandle) {
-    if (!valid_file_handle(fhandle) ||
-        free_open_file_entries[fhandle] != TAKEN) {
+    if (!valid_file_handle(fhandle)) {
+        return -1;
+    }
+    /* Bloqueia o trinco da tabela de ficheiros abertos. */
+    pthread_mutex_lock(&vs_mutex);
+    if (free_open_file_entries[fhandle] != TAKEN) {
+        /* Desbloqueia o trinco da tabela de ficheiros abertos. */
+        pthread_mutex_unlock(&vs_mutex);
         return -1;
     }
     free_open_file_entries[fhandle] = FREE;
     open_file_count--;
+    /* Desbloqueia o trinco da tabela de ficheiros abertos. */
+    pthread_mutex_unlock(&vs_mutex);
     return 0;
 }
 
@@ -340,4 +522,14 @@ open_file_entry_t *get_open_file_entry(int fhandle) {
         return NULL;
     }
     return &open_file_table[fhandle];
-}
\ No newline at end of file
+}
+
+/* Returns the number of entries in use in the open file table */
+int open_file_table_count() {
+    /* Bloqueia o trinco da tabela de ficheiros abertos. */
+    pthread_mutex_lock(&vs_mutex);
+    int count = open_file_count;
+    /* Desbloqueia o trinco da tabela de ficheiros abertos. */
+    pthread_mutex_unlock(&vs_mutex);
+    return count;
+}
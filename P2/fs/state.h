@@ -3,11 +3,11 @@
 
 #include "config.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
-
-int open_file_count;
+#include <pthread.h>
 
 /*
  * Directory entry
@@ -15,6 +15,8 @@ int open_file_count;
 typedef struct {
     char d_name[MAX_FILE_NAME];
     int d_inumber;
+    uint16_t d_hash; /* fingerprint of d_name (see name_fingerprint()) */
+    int16_t d_next;  /* next entry in the same hash chain, -1 if last */
 } dir_entry_t;
 
 typedef enum { T_FILE, T_DIRECTORY } inode_type;
@@ -26,6 +28,9 @@ typedef struct {
     inode_type i_node_type;
     size_t i_size;
     int i_data_block;
+    /* Directories: first entry of each hash chain, by fingerprint */
+    int i_dir_buckets[DIR_BUCKETS];
+    pthread_rwlock_t i_lock; /* read write lock para inodes */
     /* in a real FS, more fields would exist here */
 } inode_t;
 
@@ -37,6 +42,7 @@ typedef enum { FREE = 0, TAKEN = 1 } allocation_state_t;
 typedef struct {
     int of_inumber;
     size_t of_offset;
+    pthread_mutex_t of_mutex;
 } open_file_entry_t;
 
 #define MAX_DIR_ENTRIES (BLOCK_SIZE / sizeof(dir_entry_t))
@@ -59,5 +65,6 @@ void *data_block_get(int block_number);
 int add_to_open_file_table(int inumber, size_t offset);
 int remove_from_open_file_table(int fhandle);
 open_file_entry_t *get_open_file_entry(int fhandle);
+int open_file_table_count();
 
 #endif // STATE_H
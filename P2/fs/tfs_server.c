@@ -20,9 +20,12 @@ typedef struct commands
     char pipename[MAX_PIPE_NAME];
     char op_code;
     char name[40];
+    char path[MAX_PIPE_NAME]; /* host path name */
     int fnum;
+    off_t offset;
     size_t len;
     char* buf;
+    int ready; /* a command was passed and the consumer did not take it yet */
 
 }command_t;
 
@@ -107,7 +110,7 @@ int main(int argc, char **argv) {
 }
 
 void *producer(void *pipename) {
-    int spipe, cpipe;
+    int spipe, wpipe, cpipe;
     command_t cbuf;
     int r, vi;
     ssize_t vs;
@@ -124,6 +127,19 @@ void *producer(void *pipename) {
         exit(EXIT_FAILURE);
     }
 
+    /* KEEP A WRITER OPEN, SO THAT READS WAIT FOR THE NEXT CLIENT INSTEAD OF
+     * RETURNING 0 WHEN ALL THE CLIENTS HAVE CLOSED THE PIPE */
+    do
+    {
+        wpipe = open(pipename, O_WRONLY);
+    } while (wpipe == -1 && errno == EINTR);
+
+    if (wpipe == -1)
+    {
+        fprintf(stderr, "[ERR]: server open failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
     /* READ AND PROCESS COMMANDS WHILE ON */
     while(status == ON)
     {
@@ -205,8 +221,12 @@ void *producer(void *pipename) {
                         memcpy(buffer[i].pipename, cbuf.pipename, MAX_PIPE_NAME*sizeof(char));
                         /* CALL CONSUMER THREAD */
                         pthread_mutex_lock(&m[i]);
+                        buffer[i].ready = 1;
                         pthread_cond_signal(&c_cons[i]);
                         pthread_mutex_unlock(&m[i]);
+                        /* ONE SESSION PER CLIENT */
+                        session_count++;
+                        break;
                     }
                 }
             }
@@ -229,6 +249,7 @@ void *producer(void *pipename) {
 
             /* CALL CONSUMER THREAD */
             pthread_mutex_lock(&m[cbuf.session_id]);
+            buffer[cbuf.session_id].ready = 1;
             pthread_cond_signal(&c_cons[cbuf.session_id]);
             pthread_mutex_unlock(&m[cbuf.session_id]);
             
@@ -273,6 +294,7 @@ void *producer(void *pipename) {
 
             /* CALL CONSUMER THREAD */
             pthread_mutex_lock(&m[cbuf.session_id]);
+            buffer[cbuf.session_id].ready = 1;
             pthread_cond_signal(&c_cons[cbuf.session_id]);
             pthread_mutex_unlock(&m[cbuf.session_id]);
             break;
@@ -305,6 +327,7 @@ void *producer(void *pipename) {
 
             /* CALL CONSUMER THREAD */
             pthread_mutex_lock(&m[cbuf.session_id]);
+            buffer[cbuf.session_id].ready = 1;
             pthread_cond_signal(&c_cons[cbuf.session_id]);
             pthread_mutex_unlock(&m[cbuf.session_id]);
             break;
@@ -360,6 +383,7 @@ void *producer(void *pipename) {
 
             /* CALL CONSUMER THREAD */
             pthread_mutex_lock(&m[cbuf.session_id]);
+            buffer[cbuf.session_id].ready = 1;
             pthread_cond_signal(&c_cons[cbuf.session_id]);
             pthread_mutex_unlock(&m[cbuf.session_id]);
             break;
@@ -403,6 +427,173 @@ void *producer(void *pipename) {
 
             /* CALL CONSUMER THREAD */
             pthread_mutex_lock(&m[cbuf.session_id]);
+            buffer[cbuf.session_id].ready = 1;
+            pthread_cond_signal(&c_cons[cbuf.session_id]);
+            pthread_mutex_unlock(&m[cbuf.session_id]);
+            break;
+
+        case '8': /* PWRITE */
+            /* READ SESSION ID */
+            do
+            {
+                vs = read(spipe, &cbuf.session_id, sizeof(int));
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* READ FHANDLE*/
+            do
+            {
+                vs = read(spipe, &buffer[cbuf.session_id].fnum, sizeof(int));
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* READ OFFSET*/
+            do
+            {
+                vs = read(spipe, &buffer[cbuf.session_id].offset, sizeof(off_t));
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* READ LEN*/
+            do
+            {
+                vs = read(spipe, &buffer[cbuf.session_id].len, sizeof(size_t));
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* READ CONTENT*/
+            buffer[cbuf.session_id].buf = (char*) malloc(buffer[cbuf.session_id].len);
+            do
+            {
+                vs = read(spipe, buffer[cbuf.session_id].buf, buffer[cbuf.session_id].len);
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* PASS OP_CODE TO COMMAND BUFFER */
+            buffer[cbuf.session_id].op_code = '8';
+
+            /* CALL CONSUMER THREAD */
+            pthread_mutex_lock(&m[cbuf.session_id]);
+            buffer[cbuf.session_id].ready = 1;
+            pthread_cond_signal(&c_cons[cbuf.session_id]);
+            pthread_mutex_unlock(&m[cbuf.session_id]);
+            break;
+
+        case '9': /* PREAD */
+            /* READ SESSION ID */
+            do
+            {
+                vs = read(spipe, &cbuf.session_id, sizeof(int));
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* READ FHANDLE*/
+            do
+            {
+                vs = read(spipe, &buffer[cbuf.session_id].fnum, sizeof(int));
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* READ OFFSET*/
+            do
+            {
+                vs = read(spipe, &buffer[cbuf.session_id].offset, sizeof(off_t));
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* READ LEN*/
+            do
+            {
+                vs = read(spipe, &buffer[cbuf.session_id].len, sizeof(size_t));
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* PASS OP_CODE TO COMMAND BUFFER */
+            buffer[cbuf.session_id].op_code = '9';
+
+            /* CALL CONSUMER THREAD */
+            pthread_mutex_lock(&m[cbuf.session_id]);
+            buffer[cbuf.session_id].ready = 1;
+            pthread_cond_signal(&c_cons[cbuf.session_id]);
+            pthread_mutex_unlock(&m[cbuf.session_id]);
+            break;
+
+        case ':': /* COPY FROM EXTERNAL FS (OP CODE 10) */
+            /* READ SESSION ID */
+            do
+            {
+                vs = read(spipe, &cbuf.session_id, sizeof(int));
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* READ SOURCE PATH */
+            do
+            {
+                vs = read(spipe, buffer[cbuf.session_id].path, MAX_PIPE_NAME*sizeof(char));
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* READ DESTINATION NAME */
+            do
+            {
+                vs = read(spipe, buffer[cbuf.session_id].name, MAX_PIPE_NAME*sizeof(char));
+            } while (vs == -1 && errno == EINTR);
+
+            if (vs == -1)
+            {
+                fprintf(stderr, "[ERR]: server read failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            /* PASS OP_CODE TO COMMAND BUFFER */
+            buffer[cbuf.session_id].op_code = ':';
+
+            /* CALL CONSUMER THREAD */
+            pthread_mutex_lock(&m[cbuf.session_id]);
+            buffer[cbuf.session_id].ready = 1;
             pthread_cond_signal(&c_cons[cbuf.session_id]);
             pthread_mutex_unlock(&m[cbuf.session_id]);
             break;
@@ -423,6 +614,7 @@ void *producer(void *pipename) {
             buffer[cbuf.session_id].op_code = '7';
             /* CALL CONSUMER THREAD */
             pthread_mutex_lock(&m[cbuf.session_id]);
+            buffer[cbuf.session_id].ready = 1;
             pthread_cond_signal(&c_cons[cbuf.session_id]);
             pthread_mutex_unlock(&m[cbuf.session_id]);
             break;
@@ -433,6 +625,7 @@ void *producer(void *pipename) {
     }
 
     /* CLOSE SERVER PIPE */
+    close(wpipe);
     do
     {
         r = close(spipe);
@@ -450,6 +643,7 @@ void *consumer(void *buffer) {
     int cpipe;
     int r;
     ssize_t msg, rt;
+    char *data;
     command_t* command;
 
     command = (command_t *) buffer;
@@ -457,7 +651,12 @@ void *consumer(void *buffer) {
     while (status == ON) {
         /* I AWAIT YOUR COMMAND */
         pthread_mutex_lock(&m[command->session_id]);
-        pthread_cond_wait(&c_cons[command->session_id],&m[command->session_id]);
+        /* A COMMAND PASSED BEFORE WE GOT HERE IS NOT MISSED */
+        while (!command->ready)
+        {
+            pthread_cond_wait(&c_cons[command->session_id],&m[command->session_id]);
+        }
+        command->ready = 0;
 
         switch (command->op_code)
         {
@@ -614,8 +813,10 @@ void *consumer(void *buffer) {
 
             case '6': /* READ */
                 /* CALL TFS_READ */
-                command->buf = (char*) malloc(command->len);
-                rt = tfs_read(command->fnum,command->buf,command->len);
+                /* THE PRODUCER MAY PASS THE NEXT COMMAND (AND ITS BUF) AS
+                 * SOON AS THE CLIENT HAS THE REPLY */
+                data = (char*) malloc(command->len);
+                rt = tfs_read(command->fnum,data,command->len);
                 /* RETURN RESULT TO CLIENT
                  * NUMBER OF READ BYTES */
                 do
@@ -636,12 +837,12 @@ void *consumer(void *buffer) {
                         exit(EXIT_FAILURE);
                     }
                 }
-                if (rt != -1)
+                if (rt > 0)
                 {
                     /* PREVIOUSLY READ CONTENT */
                     do
                     {
-                        msg = write(cpipe,command->buf,command->len);
+                        msg = write(cpipe,data,(size_t)rt);
                     } while (msg == -1 && errno == EINTR);
 
                     if (msg == -1)
@@ -659,7 +860,106 @@ void *consumer(void *buffer) {
                     }
                 }
                 /* FREE BUF */
+                free(data);
+                break;
+
+            case '8': /* PWRITE */
+                /* CALL TFS_PWRITE */
+                rt = tfs_pwrite(command->fnum,command->buf,command->len,command->offset);
                 free(command->buf);
+                /* RETURN RESULT TO CLIENT */
+                do
+                {
+                    msg = write(cpipe,&rt,sizeof(ssize_t));
+                } while (msg == -1 && errno == EINTR);
+
+                if (msg == -1)
+                {
+                    if (errno == EPIPE)
+                    {
+                        close(session_status[command->session_id]);
+                        session_status[command->session_id] = -1;
+                        session_count--;
+                    } else
+                    {
+                        fprintf(stderr, "[ERR]: client pipe write by server failed: %s\n", strerror(errno));
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                break;
+
+            case '9': /* PREAD */
+                /* CALL TFS_PREAD */
+                data = (char*) malloc(command->len);
+                rt = tfs_pread(command->fnum,data,command->len,command->offset);
+                /* RETURN RESULT TO CLIENT
+                 * NUMBER OF READ BYTES */
+                do
+                {
+                    msg = write(cpipe,&rt,sizeof(ssize_t));
+                } while (msg == -1 && errno == EINTR);
+
+                if (msg == -1)
+                {
+                    if (errno == EPIPE)
+                    {
+                        close(session_status[command->session_id]);
+                        session_status[command->session_id] = -1;
+                        session_count--;
+                    } else
+                    {
+                        fprintf(stderr, "[ERR]: client pipe write by server failed: %s\n", strerror(errno));
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                if (rt > 0)
+                {
+                    /* PREVIOUSLY READ CONTENT */
+                    do
+                    {
+                        msg = write(cpipe,data,(size_t)rt);
+                    } while (msg == -1 && errno == EINTR);
+
+                    if (msg == -1)
+                    {
+                        if (errno == EPIPE)
+                        {
+                            close(session_status[command->session_id]);
+                            session_status[command->session_id] = -1;
+                            session_count--;
+                        } else
+                        {
+                            fprintf(stderr, "[ERR]: client pipe write by server failed: %s\n", strerror(errno));
+                            exit(EXIT_FAILURE);
+                        }
+                    }
+                }
+                /* FREE BUF */
+                free(data);
+                break;
+
+            case ':': /* COPY FROM EXTERNAL FS (OP CODE 10) */
+                /* CALL TFS_COPY_FROM_EXTERNAL_FS */
+                r = tfs_copy_from_external_fs(command->path,command->name);
+                /* RETURN RESULT TO CLIENT */
+                do
+                {
+                    msg = write(cpipe,&r,sizeof(int));
+                } while (msg == -1 && errno == EINTR);
+
+                if (msg == -1)
+                {
+                    if (errno == EPIPE)
+                    {
+                        close(session_status[command->session_id]);
+                        session_status[command->session_id] = -1;
+                        session_count--;
+                    } else
+                    {
+                        fprintf(stderr, "[ERR]: client pipe write by server failed: %s\n", strerror(errno));
+                        exit(EXIT_FAILURE);
+                    }
+                }
                 break;
 
             case '7': /* SHUTDOWN */
@@ -0,0 +1,73 @@
+#include "client/tecnicofs_client_api.h"
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*  Starts a TecnicoFS server (fs/tfs_server, so run this test from the
+    project's root) and, as its client, has it import a file of the host's
+    file system, then reads the file back from TecnicoFS. */
+
+#define BLOCK (1024)
+
+static char const *server_pipe = "/tmp/tfs_copy_test_server";
+static char const *client_pipe = "/tmp/tfs_copy_test_client";
+static char const *host_file = "/tmp/tfs_copy_test_source";
+
+static pid_t start_server() {
+    unlink(server_pipe);
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        execl("fs/tfs_server", "tfs_server", server_pipe, (char *)NULL);
+        _exit(1);
+    }
+    return pid;
+}
+
+int main() {
+    char data[700], buffer[BLOCK];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)('A' + i % 26);
+    }
+    FILE *fp = fopen(host_file, "w");
+    assert(fp != NULL);
+    assert(fwrite(data, 1, sizeof(data), fp) == sizeof(data));
+    assert(fclose(fp) == 0);
+
+    pid_t server = start_server();
+    assert(tfs_mount(client_pipe, server_pipe) == 0);
+
+    /* Overwrites what the file held before */
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+    memset(buffer, 'z', sizeof(buffer));
+    assert(tfs_write(f, buffer, sizeof(buffer)) == sizeof(buffer));
+    assert(tfs_close(f) != -1);
+
+    assert(tfs_copy_from_external_fs(host_file, "/f") == 0);
+
+    f = tfs_open("/f", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == sizeof(data));
+    assert(memcmp(buffer, data, sizeof(data)) == 0);
+    assert(tfs_close(f) != -1);
+
+    /* Missing source, bad destination name */
+    assert(tfs_copy_from_external_fs("/tmp/tfs_copy_test_missing", "/g") ==
+           -1);
+    assert(tfs_copy_from_external_fs(host_file, "g") == -1);
+
+    assert(tfs_unmount() == 0);
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+    unlink(server_pipe);
+    unlink(host_file);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
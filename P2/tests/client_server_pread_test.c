@@ -0,0 +1,79 @@
+#include "client/tecnicofs_client_api.h"
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*  Starts a TecnicoFS server (fs/tfs_server, so run this test from the
+    project's root) and, as its client, writes and reads a file with
+    tfs_pwrite/tfs_pread and tfs_write/tfs_read, with contents larger than
+    a single request. */
+
+#define BLOCK (1024)
+
+static char const *server_pipe = "/tmp/tfs_pread_test_server";
+static char const *client_pipe = "/tmp/tfs_pread_test_client";
+
+static pid_t start_server() {
+    unlink(server_pipe);
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        execl("fs/tfs_server", "tfs_server", server_pipe, (char *)NULL);
+        _exit(1);
+    }
+    return pid;
+}
+
+int main() {
+    char data[BLOCK], buffer[BLOCK];
+
+    for (int i = 0; i < BLOCK; i++) {
+        data[i] = (char)('a' + i % 26);
+    }
+
+    pid_t server = start_server();
+    assert(tfs_mount(client_pipe, server_pipe) == 0);
+
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+
+    /* Many requests' worth, after a hole */
+    assert(tfs_pwrite(f, data, 600, 100) == 600);
+    assert(tfs_pread(f, buffer, BLOCK, 0) == 700);
+    for (int i = 0; i < 100; i++) {
+        assert(buffer[i] == 0);
+    }
+    assert(memcmp(buffer + 100, data, 600) == 0);
+    assert(tfs_pread(f, buffer, 100, 650) == 50);
+    assert(memcmp(buffer, data + 550, 50) == 0);
+
+    /* Cut at the end of the block, and bad offsets */
+    assert(tfs_pwrite(f, data, 100, BLOCK - 10) == 10);
+    assert(tfs_pread(f, buffer, BLOCK, BLOCK) == 0);
+    assert(tfs_pwrite(f, data, 10, -1) == -1);
+    assert(tfs_pread(f, buffer, 10, -1) == -1);
+
+    /* The handle's offset did not move */
+    assert(tfs_write(f, data + 300, 300) == 300);
+    assert(tfs_close(f) != -1);
+    f = tfs_open("/f", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, BLOCK) == BLOCK);
+    assert(memcmp(buffer, data + 300, 300) == 0);
+    assert(memcmp(buffer + 300, data + 200, 400) == 0);
+    assert(memcmp(buffer + BLOCK - 10, data, 10) == 0);
+    assert(tfs_read(f, buffer, BLOCK) == 0);
+    assert(tfs_close(f) != -1);
+
+    assert(tfs_unmount() == 0);
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+    unlink(server_pipe);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
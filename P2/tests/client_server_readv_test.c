@@ -0,0 +1,75 @@
+#include "client/tecnicofs_client_api.h"
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*  Starts a TecnicoFS server (fs/tfs_server, so run this test from the
+    project's root) and, as its client, writes a file with tfs_writev and
+    reads it back with tfs_readv, with buffers that do not fit in a single
+    request. */
+
+#define BLOCK (1024)
+
+static char const *server_pipe = "/tmp/tfs_readv_test_server";
+static char const *client_pipe = "/tmp/tfs_readv_test_client";
+
+static pid_t start_server() {
+    unlink(server_pipe);
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        execl("fs/tfs_server", "tfs_server", server_pipe, (char *)NULL);
+        _exit(1);
+    }
+    return pid;
+}
+
+int main() {
+    char a[30], b[250], c[5];
+    char x[200], y[1], z[BLOCK];
+
+    memset(a, 'a', sizeof(a));
+    for (size_t i = 0; i < sizeof(b); i++) {
+        b[i] = (char)('0' + i % 10);
+    }
+    memset(c, 'c', sizeof(c));
+
+    pid_t server = start_server();
+    assert(tfs_mount(client_pipe, server_pipe) == 0);
+
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+
+    struct iovec out[] = {{a, sizeof(a)}, {NULL, 0}, {b, sizeof(b)},
+                          {c, sizeof(c)}};
+    assert(tfs_writev(f, out, 4) == 285);
+    assert(tfs_writev(f, out, 0) == 0);
+    assert(tfs_writev(f, out, -1) == -1);
+    assert(tfs_close(f) != -1);
+
+    f = tfs_open("/f", 0);
+    assert(f != -1);
+
+    /* Fills x, then y, then stops short in z */
+    struct iovec in[] = {{x, sizeof(x)}, {y, sizeof(y)}, {z, sizeof(z)}};
+    assert(tfs_readv(f, in, 3) == 285);
+    assert(memcmp(x, a, sizeof(a)) == 0);
+    assert(memcmp(x + sizeof(a), b, sizeof(x) - sizeof(a)) == 0);
+    assert(y[0] == b[sizeof(x) - sizeof(a)]);
+    assert(memcmp(z, b + sizeof(x) - sizeof(a) + 1, 79) == 0);
+    assert(memcmp(z + 79, c, sizeof(c)) == 0);
+    assert(tfs_readv(f, in, 3) == 0);
+    assert(tfs_close(f) != -1);
+
+    assert(tfs_unmount() == 0);
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+    unlink(server_pipe);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/*  Writes past the end of a file with tfs_pwrite, in a block that held
+    another file's bytes before, and checks that the bytes skipped read as
+    zeros. Note: This test uses TecnicoFS as a library, not as a
+    standalone server.
+*/
+
+int main() {
+    char data[BLOCK_SIZE], buffer[BLOCK_SIZE];
+
+    assert(tfs_init() != -1);
+
+    /* Fills a block, then frees it */
+    memset(data, 'S', sizeof(data));
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, data, sizeof(data)) == sizeof(data));
+    assert(tfs_close(f) != -1);
+    f = tfs_open("/f", TFS_O_TRUNC);
+    assert(f != -1);
+
+    /* The block is reused, past the start of the file */
+    assert(tfs_pwrite(f, "x", 1, 500) == 1);
+    assert(tfs_pread(f, buffer, sizeof(buffer), 0) == 501);
+    for (int i = 0; i < 500; i++) {
+        assert(buffer[i] == 0);
+    }
+    assert(buffer[500] == 'x');
+
+    /* And past the end of a file that is not empty */
+    assert(tfs_pwrite(f, "y", 1, 800) == 1);
+    assert(tfs_pread(f, buffer, sizeof(buffer), 0) == 801);
+    for (int i = 501; i < 800; i++) {
+        assert(buffer[i] == 0);
+    }
+    assert(buffer[500] == 'x' && buffer[800] == 'y');
+
+    assert(tfs_close(f) != -1);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}